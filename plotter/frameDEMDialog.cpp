@@ -5,6 +5,7 @@
 #include <wx/process.h>
 #include <wx/utils.h>
 #include <wx/stream.h>
+#include <wx/txtstrm.h>
 
 #include "frameDEMDialog.h"
 
@@ -65,32 +66,47 @@ void frameDEMDialog::OnConvert( wxCommandEvent& event )
 		opts.append(dtbValue);
 		opts.append(_(" -o "));
 		opts.append(otbValue);
-		opts.append(_(" -l progress -e"));
+		opts.append(_(" -l silent -e --progress-fd 1"));
 
 		wxProcess* process = wxProcess::Open(opts);
 		if (process != NULL)
 		{
 			process->Redirect();
 			wxInputStream* streamIn = process->GetInputStream();
-			wxStreamBuffer streamBuf(*streamIn, wxStreamBuffer::read);
 
-			wxProgressDialog streamPBar (_("Running 'stream'"), _("Filling Sinkholes... (May take a while.)"), 100, this, wxPD_APP_MODAL | wxPD_AUTO_HIDE);
+			wxProgressDialog streamPBar (_("Running 'stream'"), _("Reading DEM..."), 100, this, wxPD_APP_MODAL | wxPD_AUTO_HIDE);
 			streamPBar.SetSize(300, 120);
-			wxChar charIn;
-			long xsize, ysize, ft;
+
+			// stream reports lines like
+			// {"phase":"fill","cells_done":1200,"cells_total":800000,"elapsed":3.141}
+			// Each phase gets its own part of the bar.
+			static const struct { const wxChar *phase, *message; int from, to; } phases[] = {
+				{ wxT("read"), wxT("Reading DEM..."), 0, 10 },
+				{ wxT("fill"), wxT("Filling Sinkholes... (May take a while.)"), 10, 50 },
+				{ wxT("directions"), wxT("Finding Flow Direction..."), 50, 58 },
+				{ wxT("flats"), wxT("Draining Flats..."), 58, 65 },
+				{ wxT("trace"), wxT("Finding Flow Totals..."), 65, 85 },
+				{ wxT("accumulate"), wxT("Finding Flow Totals..."), 85, 90 },
+				{ wxT("write"), wxT("Writing Output..."), 90, 100 }
+			};
 
 			if (streamIn != NULL) {
-				int i = 0, j = 0, k = 0;
-				while (process->IsInputOpened())
+				wxTextInputStream text(*streamIn);
+				while (process->IsInputOpened() && !streamIn->Eof())
 				{
-					charIn = streamBuf.GetChar();
-					if (charIn == '-') i++;
-					else if (charIn == '.') j++;
-					else if (charIn == '#') k++;
-
-					if (i > 0 && j == 0) streamPBar.Update(0, _("Building DEM..."));
-					else if (i > 0 && j < 0) streamPBar.Update(j * (50.0 / i), _("Finding Flow Direction..."));
-					else if (i > 0 && j == i) streamPBar.Update(j * (50.0 / i), _("Finding Flow Totals..."));
+					wxString line = text.ReadLine();
+					wxString phase = line.AfterFirst(':').AfterFirst('"').BeforeFirst('"');
+					double done = 0, total = 0;
+					line.AfterFirst(',').AfterFirst(':').BeforeFirst(',').ToDouble(&done);
+					line.AfterFirst(',').AfterFirst(',').AfterFirst(':').BeforeFirst(',').ToDouble(&total);
+
+					for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++)
+					{
+						if (phase != phases[p].phase) continue;
+						double part = (total > 0) ? done / total : 0;
+						streamPBar.Update(phases[p].from + (int)(part * (phases[p].to - phases[p].from)),
+											phases[p].message);
+					}
 				}
 			}
 			delete process;
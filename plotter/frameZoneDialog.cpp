@@ -17,15 +17,20 @@ ZoneDialog( parent )
 
 void frameZoneDialog::OnBrowseSimple( wxCommandEvent& event )
 {
-	wxFileDialog openDem (this, _("Choose a File"), _(""), _(""), _("TSV Files (*.tsv)|*.tsv"), wxOPEN, wxDefaultPosition);
+	wxFileDialog openDem (this, _("Choose a File"), _(""), _(""), _("Stream Output (*.grids;*.tsv;*.tsv.gz;*.tsv.zst)|*.grids;*.tsv;*.tsv.gz;*.tsv.zst"), wxOPEN, wxDefaultPosition);
 	if ( openDem.ShowModal() == wxID_OK )
 	{
 		wxString path;
 		path.append( openDem.GetFilename() );
 
-		int i;
-		for (i = path.length(); path.substr(i,1) != _("-"); i--);
-		path = path.substr(0, i);
+		if (path.EndsWith(_(".grids")))
+			path = path.substr(0, path.length() - 6);
+		else
+		{
+			int i;
+			for (i = path.length(); path.substr(i,1) != _("-"); i--);
+			path = path.substr(0, i);
+		}
 
 		SimpleBox->SetValue(path);
 
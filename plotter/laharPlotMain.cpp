@@ -109,7 +109,7 @@ void laharPlotFrame::OnLoadSdem(wxCommandEvent &event)
 {
 	delete zoneImage;
 	// Open file dialog box
-	wxFileDialog openSdem (this, _("Choose a File"), _(""), _(""), _("SDEM files (*-sdem.tsv)|*-sdem.tsv"), wxOPEN, wxDefaultPosition);
+	wxFileDialog openSdem (this, _("Choose a File"), _(""), _(""), _("SDEM files (*.grids;*-sdem.tsv;*-sdem.tsv.gz;*-sdem.tsv.zst)|*.grids;*-sdem.tsv;*-sdem.tsv.gz;*-sdem.tsv.zst"), wxOPEN, wxDefaultPosition);
 
 	// Show dialog box
 	if ( openSdem.ShowModal() == wxID_OK )
@@ -120,7 +120,10 @@ void laharPlotFrame::OnLoadSdem(wxCommandEvent &event)
 		path.append( wxFileName::GetPathSeparator() );
 		path.append( openSdem.GetFilename() );
 
-		SetFile(path.substr(0, path.Length() - 9));
+		if (path.EndsWith(_(".grids")))
+			SetFile(path.substr(0, path.Length() - 6));
+		else
+			SetFile(path.substr(0, path.rfind(_("-sdem.tsv"))));
 	}
 }
 
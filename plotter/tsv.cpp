@@ -8,6 +8,8 @@
  **************************************************************/
 
 #include "tsv.h"
+#include "../stream/gridfile.h"
+#include "../stream/tsvinput.h"
 
 #include <wx/msgdlg.h>
 
@@ -43,6 +45,24 @@ float tsv::getMax()
 void tsv::setFileName(wxString filename, wxProgressDialog* progDlg, float start, float end)
 {
     tsvFileName = filename.mb_str(wxConvUTF8);
+
+    // stream's grid file has the same grids, and needs no parsing
+    const char *layers[] = {"sdem", "fdir", "ftotal"};
+    for (int i = 0; i < 3; i++)
+    {
+        string suffix = string("-") + layers[i] + ".tsv";
+        if (tsvFileName.length() > suffix.length() &&
+            tsvFileName.compare(tsvFileName.length() - suffix.length(), suffix.length(), suffix) == 0)
+        {
+            string gridName = tsvFileName.substr(0, tsvFileName.length() - suffix.length()) + ".grids";
+            progDlg->Update(start,_("Mapping ") + filename);
+            if (ifstream(gridName.c_str()) && loadGrid(gridName, layers[i], progDlg, start, end))
+                return;
+        }
+    }
+
+    // stream may have compressed it
+    tsvFileName = findTsv(tsvFileName);
     progDlg->Update(start,_("Finding Length"));
     findLength();
     progDlg->Update(start,_("Parsing ") + filename);
@@ -54,18 +74,73 @@ const char* tsv::getFileName()
 	return tsvFileName.c_str();
 }
 
+bool tsv::loadGrid(string gridName, string layerName, wxProgressDialog* progDlg, float start, float end)
+{
+	try
+	{
+		GridFile grids(gridName);
+		int w = grids.width(), h = grids.height();
+		if (const float *cells = grids.layer<float>(layerName, gridFloat32))
+			copyLayer(cells, w, h, progDlg, start, end);
+		else if (const unsigned char *cells = grids.layer<unsigned char>(layerName, gridUInt8))
+			copyLayer(cells, w, h, progDlg, start, end);
+		else if (const boost::uint64_t *cells = grids.layer<boost::uint64_t>(layerName, gridUInt64))
+			copyLayer(cells, w, h, progDlg, start, end);
+		else
+			return false;
+	}
+	catch (std::exception &)
+	{
+		// fall back to the tsv file
+		return false;
+	}
+	return true;
+}
+
+template<typename T>
+void tsv::copyLayer(const T *cells, int width, int height, wxProgressDialog* progDlg, float start, float end)
+{
+	float max = 0, min = 0;
+	bool haveMin = false;
+	clear();
+
+	for (int k = 0; k < height; k++)
+	{
+		list<float> tsvLine;
+		for (const T *cell = cells + (long)k * width; cell < cells + (long)(k + 1) * width; cell++)
+		{
+			float temp = *cell;
+
+			// keep track of max and min, same as loadtsv
+			if (temp > max) { max = temp; }
+			if ((!haveMin || temp < min) && temp > -10000)
+			{
+				min = temp;
+				haveMin = true;
+			}
+			tsvLine.push_back(temp);
+		}
+		push_back(tsvLine);
+
+		if (k % 50 == 1) progDlg->Update(start + (k * ((end - start) / height)));
+	}
+
+	tsvMax = max;
+	tsvMin = min;
+}
+
 void tsv::findLength()
 {
 	int i = 0;
 	string line;
-	ifstream file (tsvFileName.c_str());
+	TsvInput input (tsvFileName);
+	istream file (&input);
 	while (!file.eof())
 	{
 		getline (file,line);
 		i++;
 	}
 	tsvLen = i;
-	file.close();
 }
 
 void tsv::loadtsv(wxProgressDialog* progDlg, float start, float end)
@@ -77,8 +152,9 @@ void tsv::loadtsv(wxProgressDialog* progDlg, float start, float end)
 	string line;
 	clear();
 
-	// Input filestream
-	ifstream file (tsvFileName.c_str());
+	// Input filestream, decompressed on its own thread if need be
+	TsvInput input (tsvFileName);
+	istream file (&input);
 
 	// Parse SDEM
 	while (!file.eof())
@@ -128,9 +204,6 @@ void tsv::loadtsv(wxProgressDialog* progDlg, float start, float end)
 			push_back(tsvLine);
 	}
 
-	// close the sdem
-	file.close();
-
 	// store max/min
 	tsvMax = max;
 	tsvMin = min;
@@ -11,6 +11,7 @@
 #define TSV_H
 
 #include <list>
+#include <string>
 #include <wx/string.h>
 #include <wx/progdlg.h>
 
@@ -25,6 +26,9 @@ class tsv: public std::list< std::list<float> >
         virtual const char* getFileName();
     private:
         void loadtsv(wxProgressDialog *progDlg, float start, float end);
+        bool loadGrid(std::string gridName, std::string layerName, wxProgressDialog *progDlg, float start, float end);
+        template<typename T>
+        void copyLayer(const T *cells, int width, int height, wxProgressDialog *progDlg, float start, float end);
         void findLength();
 };
 
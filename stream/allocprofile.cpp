@@ -0,0 +1,285 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "allocprofile.h"
+#include "util.h"
+
+#if defined(ALLOC_PROFILE) && defined(__GLIBC__)
+
+#include <execinfo.h>
+
+bool AllocProfile::counting = false;
+boost::mutex AllocProfile::counts_mutex;
+long long AllocProfile::live = 0;
+long long AllocProfile::peak = 0;
+long long AllocProfile::blocks = 0;
+long long AllocProfile::bytes = 0;
+AllocProfile::Phase AllocProfile::phases[PHASES];
+int AllocProfile::phaseCount = 0;
+AllocProfile::Site AllocProfile::sites[SITES];
+
+//what comes before each block: its size, and whether it was counted
+union BlockHeader
+{
+	struct
+	{
+		size_t bytes;
+		bool counted;
+	} block;
+	double align[2];	//keeps the block after it as aligned as malloc's
+};
+
+//set while a thread counts an allocation, so that what it allocates doing so isn't
+static __thread bool busy = false;
+
+bool AllocProfile::available()
+{
+	return true;
+}
+
+void AllocProfile::start()
+{
+	//the first backtrace loads what it needs, with allocations of its own
+	void *first[1];
+	busy = true;
+	backtrace(first, 1);
+	busy = false;
+
+	boost::mutex::scoped_lock lock(counts_mutex);
+	Phase& start = phases[0];
+	start.name = "start";
+	start.blocks = start.bytes = start.peak = start.end = 0;
+	phaseCount = 1;
+	counting = true;
+}
+
+void AllocProfile::phase(const char *name)
+{
+	Phase ended;
+	{
+		boost::mutex::scoped_lock lock(counts_mutex);
+		if(!counting) return;
+		Phase& last = phases[phaseCount-1];
+		last.end = live;
+		ended = last;
+		if(phaseCount < PHASES)
+		{
+			Phase& next = phases[phaseCount++];
+			next.name = name;
+			next.blocks = next.bytes = 0;
+			next.peak = live;
+		}else{
+			last.name = "(later phases)";
+		}
+	}
+	LOG(normal, "Memory: " << ended.name << " allocated " << ended.blocks << " blocks, "
+		<< ended.bytes/1024 << " kB; at most " << ended.peak/1024 << " kB live, "
+		<< ended.end/1024 << " kB at the end\n");
+}
+
+bool AllocProfile::write(const string& path, int top)
+{
+	FILE *out = fopen(path.c_str(), "w");
+	if(out == NULL) return false;
+	boost::mutex::scoped_lock lock(counts_mutex);
+	phases[phaseCount-1].end = live;
+	fprintf(out, "phase\tblocks\tbytes\tpeak live bytes\tlive bytes at end\n");
+	for(int i = 0; i < phaseCount; i++)
+		fprintf(out, "%s\t%lld\t%lld\t%lld\t%lld\n", phases[i].name,
+				phases[i].blocks, phases[i].bytes, phases[i].peak, phases[i].end);
+	fprintf(out, "all\t%lld\t%lld\t%lld\t%lld\n", blocks, bytes, peak, live);
+
+	//the sites with the most bytes, each with the return addresses above it
+	int order[SITES], used = 0;
+	for(int i = 0; i < SITES; i++)
+		if(sites[i].blocks != 0) order[used++] = i;
+	sort(order, order + used, moreBytes);
+	fprintf(out, "\nsite\tblocks\tbytes\n");
+	for(int i = 0; i < min(top, used); i++)
+	{
+		const Site& from = sites[order[i]];
+		fprintf(out, "%d\t%lld\t%lld\n", i+1, from.blocks, from.bytes);
+		if(order[i] == SITES-1) fprintf(out, "\t(sites that didn't fit in the table)\n");
+		//with malloc, so nothing new is counted while the lock is held
+		char **names = backtrace_symbols(from.stack, from.frames);
+		for(int frame = 0; frame < from.frames; frame++)
+			fprintf(out, "\t%s\n", names ? names[frame] : "?");
+		free(names);
+	}
+	return fclose(out) == 0;
+}
+
+//not inlined, so the backtrace always has the same two frames to skip
+__attribute__((noinline)) void *AllocProfile::allocate(size_t bytes)
+{
+	BlockHeader *header = (BlockHeader*)malloc(sizeof(BlockHeader) + bytes);
+	if(header == NULL) return NULL;
+	header->block.bytes = bytes;
+	header->block.counted = false;
+	if(counting && !busy)
+	{
+		busy = true;
+		void *stack[DEPTH + 2];
+		int frames = backtrace(stack, DEPTH + 2);
+		//not this function or operator new
+		count(bytes, stack + 2, max(frames - 2, 0));
+		header->block.counted = true;
+		busy = false;
+	}
+	return header + 1;
+}
+
+void AllocProfile::release(void *block)
+{
+	if(block == NULL) return;
+	BlockHeader *header = (BlockHeader*)block - 1;
+	if(header->block.counted)
+	{
+		boost::mutex::scoped_lock lock(counts_mutex);
+		live -= header->block.bytes;
+	}
+	free(header);
+}
+
+void AllocProfile::count(size_t size, void **stack, int frames)
+{
+	boost::mutex::scoped_lock lock(counts_mutex);
+	live += size;
+	peak = max(peak, live);
+	blocks++;
+	bytes += size;
+	Phase& now = phases[phaseCount-1];
+	now.blocks++;
+	now.bytes += size;
+	now.peak = max(now.peak, live);
+	Site& from = site(stack, frames);
+	from.blocks++;
+	from.bytes += size;
+}
+
+AllocProfile::Site& AllocProfile::site(void **stack, int frames)
+{
+	size_t hash = frames;
+	for(int i = 0; i < frames; i++) hash = hash*31 + (size_t)stack[i];
+	for(int probe = 0; probe < SITES-1; probe++)
+	{
+		Site& slot = sites[(hash + probe) % (SITES-1)];
+		if(slot.blocks == 0)
+		{
+			copy(stack, stack + frames, slot.stack);
+			slot.frames = frames;
+			return slot;
+		}
+		if(slot.frames == frames && equal(stack, stack + frames, slot.stack)) return slot;
+	}
+	return sites[SITES-1];
+}
+
+bool AllocProfile::moreBytes(int a, int b)
+{
+	return sites[a].bytes > sites[b].bytes;
+}
+
+//dynamic exception specifications were dropped in C++17
+#if __cplusplus < 201103L
+#define NEW_THROWS throw(std::bad_alloc)
+#define NEW_NOTHROW throw()
+#else
+#define NEW_THROWS
+#define NEW_NOTHROW noexcept
+#endif
+
+void *operator new(size_t bytes) NEW_THROWS
+{
+	void *block = AllocProfile::allocate(bytes);
+	if(block == NULL) throw std::bad_alloc();
+	return block;
+}
+
+void *operator new[](size_t bytes) NEW_THROWS
+{
+	void *block = AllocProfile::allocate(bytes);
+	if(block == NULL) throw std::bad_alloc();
+	return block;
+}
+
+void *operator new(size_t bytes, const std::nothrow_t&) NEW_NOTHROW
+{
+	return AllocProfile::allocate(bytes);
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t&) NEW_NOTHROW
+{
+	return AllocProfile::allocate(bytes);
+}
+
+void operator delete(void *block) NEW_NOTHROW
+{
+	AllocProfile::release(block);
+}
+
+void operator delete[](void *block) NEW_NOTHROW
+{
+	AllocProfile::release(block);
+}
+
+void operator delete(void *block, const std::nothrow_t&) NEW_NOTHROW
+{
+	AllocProfile::release(block);
+}
+
+void operator delete[](void *block, const std::nothrow_t&) NEW_NOTHROW
+{
+	AllocProfile::release(block);
+}
+
+#else
+
+//Built without it, new and delete are the usual ones, and nothing is counted.
+
+bool AllocProfile::available()
+{
+	return false;
+}
+
+void AllocProfile::start() {}
+
+void AllocProfile::phase(const char *name) {}
+
+bool AllocProfile::write(const string& path, int top)
+{
+	return false;
+}
+
+void *AllocProfile::allocate(size_t bytes)
+{
+	return malloc(bytes);
+}
+
+void AllocProfile::release(void *block)
+{
+	free(block);
+}
+
+#endif
@@ -0,0 +1,86 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ALLOCPROFILE_H
+#define ALLOCPROFILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+using namespace std;
+
+/*	Counts what stream allocates with new, for --alloc-profile: how many blocks
+	and bytes each phase (see Progress) allocates, the most bytes live at once
+	during it, and the call sites the bytes come from. It is only there when
+	stream is built with -DALLOC_PROFILE, on glibc, which puts its own operator
+	new and delete in front of malloc; each block then carries a small header
+	with its size. Nothing is counted until start(), and after that every
+	allocation takes a lock and a short backtrace. Memory that GDAL or Boost
+	get with malloc, and the scratch files of --out-of-core, aren't counted.
+*/
+class AllocProfile
+{
+	public:
+	//whether this build has the allocator in it
+	static bool available();
+	//count every allocation from now on
+	static void start();
+	//a new phase starts; logs the one that ended, with the most bytes it had live
+	static void phase(const char *name);
+	//write the phases, and the sites with the most bytes allocated, to the file
+	static bool write(const string& path, int sites);
+
+	//for operator new and delete
+	static void *allocate(size_t bytes);
+	static void release(void *block);
+
+	private:
+	enum {DEPTH = 6, SITES = 4096, PHASES = 64};
+
+	//a place allocations come from, told apart by the return addresses above it
+	struct Site
+	{
+		void *stack[DEPTH];
+		int frames;
+		long long blocks, bytes;
+	};
+	struct Phase
+	{
+		const char *name;
+		long long blocks, bytes;	//allocated during it
+		long long peak, end;		//bytes live, at most and when it ended
+	};
+
+	static bool counting;
+	static boost::mutex counts_mutex;
+	static long long live, peak, blocks, bytes;
+	static Phase phases[PHASES];
+	static int phaseCount;
+	//an open-addressed table, with the last slot for whatever doesn't fit
+	static Site sites[SITES];
+
+	static void count(size_t bytes, void **stack, int frames);
+	static Site& site(void **stack, int frames);
+	//for sorting the sites, the most bytes first
+	static bool moreBytes(int a, int b);
+};
+
+#endif
@@ -0,0 +1,162 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "batch.h"
+
+namespace pt = boost::posix_time;
+
+//a DEM gets one more thread for each this many cells (a 1024x1024 tile)
+const long long CELLS_PER_THREAD = 1 << 20;
+
+void ThreadBudget::acquire(int job, int threads)
+{
+	boost::mutex::scoped_lock lock(budget_mutex);
+	while(serving != job || available < threads)
+		changed.wait(lock);
+	available -= threads;
+	serving++;
+	changed.notify_all();
+}
+
+void ThreadBudget::release(int threads)
+{
+	boost::mutex::scoped_lock lock(budget_mutex);
+	available += threads;
+	changed.notify_all();
+}
+
+Batch::Batch(const TerrainOptions& options, const OutputOptions& output)
+	: options(options), output(output), jobs(NULL), nextJob(0),
+	budget(max(options.threads, 1))
+{
+	if(this->options.threads < 1) this->options.threads = 1;
+}
+
+bool Batch::readList(const string& path, vector<BatchJob>& jobs)
+{
+	fs::ifstream list(path);
+	if(!list) return false;
+	string line;
+	while(getline(list, line))
+	{
+		if(!line.empty() && line[line.size()-1] == '\r') line.erase(line.size()-1);
+		if(line.empty() || line[0] == '#') continue;
+		BatchJob job;
+		size_t tab = line.find('\t');
+		job.input = line.substr(0, tab);
+		if(tab != string::npos)
+			job.output = line.substr(tab+1);
+		if(job.output.empty())
+			job.output = fs::path(job.input).replace_extension("").string();
+		jobs.push_back(job);
+	}
+	return !list.bad();
+}
+
+bool Batch::run(const vector<BatchJob>& jobs)
+{
+	this->jobs = &jobs;
+	results.assign(jobs.size(), Result());
+	nextJob = 0;
+
+	int workers = min<int>(options.threads, jobs.size());
+	boost::thread_group pool;
+	for(int worker = 0; worker < workers; worker++)
+		pool.add_thread(new boost::thread(&Batch::work, this));
+	pool.join_all();
+
+	for(size_t job = 0; job < results.size(); job++)
+		if(!results[job].ok) return false;
+	return true;
+}
+
+void Batch::writeSummary(ostream& out) const
+{
+	out << "input\toutput\tstatus\tthreads\tcells\tseconds\tmessage\n";
+	for(size_t job = 0; job < results.size(); job++)
+	{
+		const Result& result = results[job];
+		string message = result.message;
+		replace(message.begin(), message.end(), '\n', ' ');
+		out << (*jobs)[job].input << '\t' << (*jobs)[job].output << '\t'
+			<< (result.ok ? "ok" : "failed") << '\t' << result.threads << '\t'
+			<< result.cells << '\t' << fixed << setprecision(3) << result.seconds
+			<< '\t' << message << '\n';
+	}
+	out.flush();
+}
+
+int Batch::threadsFor(long long cells) const
+{
+	return (int)max(1LL, min<long long>(options.threads, cells / CELLS_PER_THREAD));
+}
+
+void Batch::work()
+{
+	while(true)
+	{
+		int job;
+		{
+			boost::mutex::scoped_lock lock(jobs_mutex);
+			if(nextJob >= (int)jobs->size()) return;
+			job = nextJob++;
+		}
+		process(job);
+	}
+}
+
+void Batch::process(int job)
+{
+	const BatchJob& dem = (*jobs)[job];
+	Result& result = results[job];
+
+	//the size says how many threads it gets, so look before waiting for them
+	GDALDataset *dataset = (GDALDataset*)GDALOpen(dem.input.c_str(), GA_ReadOnly);
+	if(dataset != NULL)
+	{
+		result.cells = (long long)dataset->GetRasterXSize() * dataset->GetRasterYSize();
+		result.threads = threadsFor(result.cells);
+	}
+	budget.acquire(job, result.threads);
+
+	pt::ptime started = pt::microsec_clock::universal_time();
+	if(dataset == NULL)
+	{
+		result.message = "There was a problem opening the topography file.";
+	}else{
+		LOG(normal, dem.input << ": processing on " << result.threads << " thread(s)\n");
+		TerrainOptions demOptions = options;
+		demOptions.threads = result.threads;
+		try{
+			streamDem(dataset, dem.output, demOptions, output);
+			result.ok = true;
+		}catch(exception& e){
+			result.message = e.what();
+		}
+	}
+	result.seconds = (pt::microsec_clock::universal_time() - started).total_microseconds() / 1e6;
+	budget.release(result.threads);
+
+	if(result.ok)
+		LOG(normal, dem.input << ": done\n");
+	else
+		LOG(normal, dem.input << ": " << result.message << '\n');
+}
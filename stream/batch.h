@@ -0,0 +1,104 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "main.h"
+
+//one DEM of a batch, and the base name of its outputs
+struct BatchJob
+{
+	string input, output;
+};
+
+/*	Shares the batch's threads out among its DEMs in the order they're listed,
+	so a big DEM that wants all of them isn't kept waiting by the small ones
+	after it.
+*/
+class ThreadBudget
+{
+	public:
+	ThreadBudget(int threads) : available(threads), serving(0) {}
+	//wait for the job's turn and for that many threads to be free, and take them
+	void acquire(int job, int threads);
+	void release(int threads);
+
+	private:
+	int available;
+	int serving;		//the job whose turn it is
+	boost::mutex budget_mutex;
+	boost::condition_variable changed;
+};
+
+/*	Processes a list of DEMs in one process, on as many worker threads as the
+	threads option says. Each DEM is given a thread for every CELLS_PER_THREAD
+	cells it has, up to all of them, so small DEMs are done side by side on a
+	thread each and a big one has every thread to itself.
+*/
+class Batch
+{
+	public:
+	Batch(const TerrainOptions& options, const OutputOptions& output);
+
+	/*	Read a list of DEMs, one a line: the input file, then a tab and the base
+		name of its outputs. Without one, the outputs are named after the input,
+		less its extension. Blank lines and lines starting with # are skipped.
+		Returns false if the list can't be read.
+	*/
+	static bool readList(const string& path, vector<BatchJob>& jobs);
+
+	//process all the DEMs. Returns false if any of them failed
+	bool run(const vector<BatchJob>& jobs);
+	//a line of tab-separated text for each DEM, saying how it went
+	void writeSummary(ostream& out) const;
+
+	private:
+	struct Result
+	{
+		bool ok;
+		int threads;
+		long long cells;
+		double seconds;
+		string message;		//why it failed
+		Result() : ok(false), threads(0), cells(0), seconds(0) {}
+	};
+
+	TerrainOptions options;
+	OutputOptions output;
+	const vector<BatchJob> *jobs;
+	vector<Result> results;
+	int nextJob;
+	boost::mutex jobs_mutex;
+	ThreadBudget budget;
+
+	//how many threads a DEM with this many cells gets
+	int threadsFor(long long cells) const;
+	//take DEMs off the list until there are none left
+	void work();
+	void process(int job);
+};
+
+#endif
@@ -18,346 +18,385 @@
 */
 
 #include "cell.h"
+#include "flowdir.h"
 
-// TODO: use chained constructors when that functionality comes in C++09
-Cell::Cell(float elevation, int yIn, int xIn)
-	: height(elevation), y(yIn), x(xIn), flowTotal(0), flowTotalReady(false), flowDir(none)
-{
-	flowDirSet = new set<direction>();
-	flowTotalReady = false;
-	accumulated = false;
-}
+#include <cstring>
+#include <new>
 
-Cell::Cell(float elevation, int yIn, int xIn, direction dir)
-	: height(elevation), y(yIn), x(xIn), flowTotal(0), flowTotalReady(false), flowDir(dir)
-{
-	flowDirSet = new set<direction>();
-	flowDirSet->insert(dir);
-	flowTotalReady = false;
-	accumulated = false;
-}
+//row and column offsets to the neighbor in each direction
+static const int dY[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+static const int dX[8] = { 0, 1, 1, 1, 0, -1, -1, -1};
 
-Cell::Cell()
-	: height(-10000), y(-1), x(-1), flowTotal(0), flowTotalReady(false), flowDir(none)
+CellGrid::CellGrid(int nYSize, int nXSize)
+	: cellsY(nYSize), cellsX(nXSize), height(nYSize, nXSize), flowDir(nYSize, nXSize),
+	flowDirSet(nYSize, nXSize), flowTotal(nYSize, nXSize), noData(nYSize, (nXSize+63)/64),
+	hasNoDataValue(false), noDataValue(0)
+{}
+
+void CellGrid::fill(int y, int x, direction dir)
 {
-	flowDirSet = new set<direction>();
-	flowTotalReady = false;
-	accumulated = false;
+	long cell = index(y,x);
+	flowDir[cell] = dir;
+	flowTotal[cell] = 0;
+	//if a direction is specified, prevent it from being recalculated later
+	flowDirSet[cell] = (dir != none) ? dirBit(dir) : 0;
 }
 
-Cell::~Cell()
+bool CellGrid::claim(int y, int x, direction dir)
 {
-	delete flowDirSet;
+	long cell = index(y,x);
+	boost::mutex::scoped_lock lock(lockFor(cell));
+	if(flowDir[cell] != none) return false;
+	if(!(flowDirSet[cell] & dirBit(dir))) return false;
+	flowDir[cell] = dir;
+	flowDirSet[cell] = dirBit(dir);
+	return true;
 }
 
-void Cell::fill(float elevation, int y, int x, direction dir)
+//steps a trace takes between looks for idle threads
+static const int TRACE_CHECK = 64;
+
+void CellGrid::traceFlowDirs(int threads)
 {
-	height = elevation;
-	this->y = y;
-	this->x = x;
-	flowDir = dir;
-	//if a direction is specified, prevent it from being recalculated later
-	if(dir != none) flowDirSet->insert(dir);
+	if(threads < 1) threads = 1;
+	//Each thread starts with its own stretch of the edge. Threads work from
+	//the back of their queues, so the seeds go in backwards.
+	const long seeds = flowDir.borderSize();
+	TraceWork work(threads);
+	work.pending = seeds;
+	for(int worker = 0; worker < threads; worker++)
+	{
+		long first = seeds * worker / threads;
+		long end = seeds * (worker+1) / threads;
+		for(long seed = end; seed > first; seed--)
+			work.tasks.push(worker, TraceTask(flowDir.borderIndex(seed-1), north, true));
+	}
+	
+	boost::thread_group workers;
+	for(int worker = 1; worker < threads; worker++)
+		workers.add_thread(new boost::thread(&CellGrid::traceWorker, this, worker, &work));
+	traceWorker(0, &work);
+	workers.join_all();
 }
 
-bool Cell::getFlowTotalReady() const {return flowTotalReady;}
-
-unsigned long long Cell::getFlowTotal()
+void CellGrid::traceWorker(int worker, TraceWork *work)
 {
-	if(!flowTotalReady)
+	//cells on the current path upstream, and the next direction to try from each
+	vector<long> path;
+	vector<unsigned char> nextDir;
+	bool idle = false;
+	//a task can make more tasks, so the queues running dry isn't the end
+	while(work->pending.load(boost::memory_order_acquire) > 0)
 	{
-		boost::mutex::scoped_lock lock(getFlowTotal_mutex);	
-		if(flowTotalReady) return flowTotal;
-		accumulate();
-		flowTotalReady = true;
+		TraceTask task;
+		if(!work->tasks.pop(worker, task))
+		{
+			if(!idle) work->idle.fetch_add(1, boost::memory_order_relaxed);
+			idle = true;
+			boost::this_thread::yield();
+			continue;
+		}
+		if(idle) work->idle.fetch_sub(1, boost::memory_order_relaxed);
+		idle = false;
+		
+		if(task.seed)
+		{
+			lg.write(progress, '#');
+			LOG(debug, "Seed accumulation " << task.cell << '\n');
+			Progress::advance(1);
+		}
+		path.assign(1, task.cell);
+		nextDir.assign(1, task.dir);
+		trace(worker, work, path, nextDir);
+		work->pending.fetch_sub(1, boost::memory_order_release);
 	}
-	return flowTotal;
+	if(idle) work->idle.fetch_sub(1, boost::memory_order_relaxed);
 }
 
-void Cell::setFlowDir(direction dir)
+void CellGrid::trace(int worker, TraceWork *work, vector<long>& path, vector<unsigned char>& nextDir)
 {
-	flowDir = dir;
-	flowDirSet->clear();
-	flowDirSet->insert(dir);
+	int steps = 0;
+	while(!path.empty())
+	{
+		int dir = nextDir.back();
+		if(dir == none)
+		{
+			path.pop_back();
+			nextDir.pop_back();
+			continue;
+		}
+		nextDir.back()++;
+		int ny = path.back() / cellsX + dY[dir], nx = path.back() % cellsX + dX[dir];
+		if(ny >= 0 && nx >= 0 && ny < cellsY && nx < cellsX
+			//the neighbor flows here if it goes in the opposite direction
+			&& claim(ny, nx, intDirection((dir+4)%8)))
+		{
+			path.push_back(index(ny,nx));
+			nextDir.push_back(north);
+		}
+		
+		if(++steps < TRACE_CHECK) continue;
+		steps = 0;
+		if(path.size() < 2 || work->idle.load(boost::memory_order_relaxed) == 0
+			|| !work->tasks.empty(worker))
+			continue;
+		//Hand over the bottom half of the path. Thieves take from the front of
+		//the queue, so they get the cell nearest the outlet first.
+		size_t share = path.size() / 2;
+		work->pending.fetch_add(share, boost::memory_order_relaxed);
+		for(size_t i = 0; i < share; i++)
+			work->tasks.push(worker, TraceTask(path[i], nextDir[i]));
+		path.erase(path.begin(), path.begin() + share);
+		nextDir.erase(nextDir.begin(), nextDir.begin() + share);
+	}
 }
 
-direction Cell::getFlowDir() {return flowDir;}
+//rows of the DEM handed out as one accumulation task
+static const int ACCUMULATE_BLOCK = 64;
+//marks an inflow counter that did not start at 0
+static const unsigned char HAS_INFLOWS = 0x80;
 
-void Cell::accumulate()
+void CellGrid::accumulate(int threads)
 {
-	ostringstream oss;
-	oss << "Calling   accumulate on " << y << ',' << x << ':' << height <<
-		" where flowTotalReady=" << (flowTotalReady?"true":"false")	<< '\n';
-	//lg.write(debug, oss.str());
-	
-	if(flowTotalReady) return;
-	
+	const long cells = (long)cellsY * cellsX;
+	boost::atomic<unsigned char> *inflows = Scratch::allocate< boost::atomic<unsigned char> >(cells);
+	for(long cell = 0; cell < cells; cell++)
+		new (&inflows[cell]) boost::atomic<unsigned char>(0);
+	for(long cell = 0; cell < cells; cell++)
 	{
-		boost::mutex::scoped_lock lock(accumulate_mutex);	
-		if(accumulated) return;
-		accumulated = true;
+		long down = downstream(cell);
+		if(down >= 0) inflows[down].fetch_add(1, boost::memory_order_relaxed);
 	}
+	//cells with inflows are flagged, so they never look like ridge cells
+	for(long cell = 0; cell < cells; cell++)
+		if(inflows[cell].load(boost::memory_order_relaxed))
+			inflows[cell].fetch_or(HAS_INFLOWS, boost::memory_order_relaxed);
+	
+	if(threads < 1) threads = 1;
+	WorkQueues<int> blocks(threads);
+	for(int block = 0; block*ACCUMULATE_BLOCK < cellsY; block++)
+		blocks.push(block % threads, block);
 	
-	oss.str("");
-	oss << "Doing full   accumulate " << y << ',' << x << ':' << height << '\n';
-	//lg.write(debug, oss.str());
+	boost::thread_group workers;
+	for(int worker = 1; worker < threads; worker++)
+		workers.add_thread(new boost::thread(&CellGrid::accumulateRows, this,
+												worker, &blocks, inflows));
+	accumulateRows(0, &blocks, inflows);
+	workers.join_all();
+	Scratch::release(inflows);
+}
 
-	Cell *adj = NULL;				//an adjacent cell
-	if(y > 0)
+void CellGrid::accumulateRows(int worker, WorkQueues<int> *blocks,
+								boost::atomic<unsigned char> *inflows)
+{
+	int block;
+	while(blocks->pop(worker, block))
 	{
-		adj = &linear(dem,y-1,x);	//north
-		if(adj->flowDirs().find(south) != adj->flowDirs().end())
+		long start = (long)block * ACCUMULATE_BLOCK * cellsX;
+		long end = min((long)(block+1) * ACCUMULATE_BLOCK, (long)cellsY) * cellsX;
+		for(long first = start; first < end; first++)
 		{
-			adj->setFlowDir(south);
-			oss.str("");
-			oss << "Going north to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
+			//only cells on the ridges start a chain
+			if(inflows[first].load(boost::memory_order_relaxed) != 0) continue;
+			for(long cell = first; cell >= 0; )
+			{
+				//every inflow is done (and visible) once the counter is at 0
+				gatherFlowTotal(cell);
+				cell = downstream(cell);
+				//whoever brings the count to 0 carries on downstream
+				if(cell >= 0 && inflows[cell].fetch_sub(1, boost::memory_order_acq_rel) != (HAS_INFLOWS|1))
+					break;
+			}
 		}
 	}
-	if(y > 0 && x < (cellsX-1))
+}
+
+void CellGrid::gatherFlowTotal(long cell)
+{
+	int y = cell / cellsX, x = cell % cellsX;
+	unsigned long long total = 0;
+	for(int dir=north; dir<none; dir++)
 	{
-		adj = &linear(dem,y-1,x+1);	//northeast
-		if(adj->flowDirs().find(southwest) != adj->flowDirs().end())
-		{
-			adj->setFlowDir(southwest);
-			oss.str("");
-			oss << "Going northeast to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
-		}
+		int ny = y + dY[dir], nx = x + dX[dir];
+		if(ny < 0 || nx < 0 || ny >= cellsY || nx >= cellsX) continue;
+		long up = index(ny,nx);
+		//the neighbor flows here if it goes in the opposite direction
+		if(flowDir[up] == (dir+4)%8)
+			total += flowTotal[up] + 1;
 	}
-	if(x < (cellsX-1))
+	flowTotal[cell] = total;
+}
+
+//what reaccumulate() knows of a cell
+static const unsigned char DIRTY = 1;		//its total may change
+static const unsigned char OLD_PATH = 2;	//the old way down from it is marked
+static const unsigned char NEW_PATH = 4;	//and the new one
+static const unsigned char INFLOW = 8;		//a dirty cell flowing in, not yet totaled
+
+void CellGrid::reaccumulate(const vector<long>& changed, GridView<const unsigned char> oldFlowDir)
+{
+	Grid<unsigned char> state(cellsY, cellsX);
+	fill_n(state.data(), state.size(), 0);
+	
+	/*	A cell's total only changes if a changed cell joins or leaves the
+		cells above it, so if it is on the way down from one, either way.
+		Each way is followed until it meets one already marked.
+	*/
+	vector<long> dirty;
+	for(size_t i = 0; i < changed.size(); i++)
 	{
-		adj = &linear(dem,y,x+1);	//east
-		if(adj->flowDirs().find(west) != adj->flowDirs().end())
+		for(long cell = changed[i]; cell >= 0 && !(state[cell] & OLD_PATH);
+			cell = downstream(cell, oldFlowDir[cell]))
 		{
-			adj->setFlowDir(west);
-			oss.str("");
-			oss << "Going east to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
+			if(!(state[cell] & DIRTY)) dirty.push_back(cell);
+			state[cell] |= DIRTY | OLD_PATH;
 		}
-	}
-	if(x < (cellsX-1) && y < (cellsY-1))
-	{
-		adj = &linear(dem,y+1,x+1);	//southeast
-		if(adj->flowDirs().find(northwest) != adj->flowDirs().end())
+		for(long cell = changed[i]; cell >= 0 && !(state[cell] & NEW_PATH); cell = downstream(cell))
 		{
-			adj->setFlowDir(northwest);
-			oss.str("");
-			oss << "Going southeast to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
+			if(!(state[cell] & DIRTY)) dirty.push_back(cell);
+			state[cell] |= DIRTY | NEW_PATH;
 		}
 	}
-	if(y < (cellsY-1))
+	
+	//total them up from the top down, as accumulate() does the whole DEM
+	for(size_t i = 0; i < dirty.size(); i++)
 	{
-		adj = &linear(dem,y+1,x);	//south
-		if(adj->flowDirs().find(north) != adj->flowDirs().end())
-		{
-			adj->setFlowDir(north);
-			oss.str("");
-			oss << "Going south to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
-		}	
+		long down = downstream(dirty[i]);
+		if(down >= 0 && (state[down] & DIRTY)) state[down] += INFLOW;
 	}
-	if(x>0 && y < (cellsY-1))
+	vector<long> ready;
+	for(size_t i = 0; i < dirty.size(); i++)
+		if(state[dirty[i]] < INFLOW) ready.push_back(dirty[i]);
+	while(!ready.empty())
 	{
-		adj = &linear(dem,y+1,x-1);	//southwest
-		if(adj->flowDirs().find(northeast) != adj->flowDirs().end())
+		long cell = ready.back();
+		ready.pop_back();
+		gatherFlowTotal(cell);
+		long down = downstream(cell);
+		if(down >= 0 && (state[down] & DIRTY))
 		{
-			adj->setFlowDir(northeast);
-			oss.str("");
-			oss << "Going southwest to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
+			state[down] -= INFLOW;
+			if(state[down] < INFLOW) ready.push_back(down);
 		}
 	}
-	if(x>0)
+}
+
+long CellGrid::downstream(long cell, int dir) const
+{
+	if(dir == none) return -1;
+	int ny = cell / cellsX + dY[dir], nx = cell % cellsX + dX[dir];
+	if(ny < 0 || nx < 0 || ny >= cellsY || nx >= cellsX) return -1;
+	return index(ny,nx);
+}
+
+//the first of the cells from x to end whose bit is set, or end if there's none
+static int nextSet(const boost::uint64_t *bits, int x, int end)
+{
+	while(x < end)
 	{
-		adj = &linear(dem,y,x-1);	//west
-		if(adj->flowDirs().find(east) != adj->flowDirs().end())
+		boost::uint64_t word = bits[x/64] & (~(boost::uint64_t)0 << (x%64));
+		if(word)
 		{
-			adj->setFlowDir(east);
-			oss.str("");
-			oss << "Going west to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
+#ifdef __GNUC__
+			return min(end, x/64*64 + __builtin_ctzll(word));
+#else
+			int bit = 0;
+			while(!(word & ((boost::uint64_t)1 << bit))) bit++;
+			return min(end, x/64*64 + bit);
+#endif
 		}
+		x = (x/64 + 1)*64;
 	}
-	if(y>0 && x>0)
+	return end;
+}
+
+//the same for a bit that is clear
+static int nextClear(const boost::uint64_t *bits, int x, int end)
+{
+	while(x < end)
 	{
-		adj = &linear(dem,y-1,x-1);	//northwest
-		if(adj->flowDirs().find(southeast) != adj->flowDirs().end())
-		{
-			adj->setFlowDir(southeast);
-			oss.str("");
-			oss << "Going northwest to " << adj->y << ',' << adj->x << '\n';
-			//lg.write(debug, oss.str());
-			flowTotal += adj->getFlowTotal() + 1;
-		}
+		if(~bits[x/64] & (~(boost::uint64_t)0 << (x%64)))
+			break;
+		x = (x/64 + 1)*64;
 	}
-	oss.str("");
-	oss << "Done with accumulate on " << y << ',' << x << ':' << height << '\n';
-	//lg.write(debug, oss.str());
-	flowTotalReady = true;
+	while(x < end && (bits[x/64] & ((boost::uint64_t)1 << (x%64)))) x++;
+	return min(x, end);
 }
 
-const set<direction>& Cell::flowDirs(FlowMethod method)
+void CellGrid::findFlowDirs(int y, FlowDirsKernel kernel)
 {
-	ostringstream oss;
-	oss << "Called flowDirs on " << y << ',' << x << '\n';
-	//lg.write(debug, oss.str());
-	if(flowDirSet->size()) return *flowDirSet;
-	boost::mutex::scoped_lock lock(flowDirs_mutex);
-	//if this was already calculated, don't do it again
-	if(flowDirSet->size()) return *flowDirSet;
-
-	oss.str("");
-	oss << "passed initial check on flowDirs on " << y << ',' << x << '\n';
-	//lg.write(debug, oss.str());
-	
-	//if we're in a no-data zone, flow off the edge of the DEM
-	oss.str("");
-	if(height < -500)
-	{
-		int to[8];		//the distance from the current cell TO each border
-		to[north] = y;
-		to[east]  = cellsX-x-1;
-		to[south] = cellsY-y-1;
-		to[west]  = x;
+	findNoData(y);
+	findFlowDirs(y, kernel, 1, cellsX-1);
+}
 
-		if(to[north] < to[west] && to[north] < to[east])
-		{
-			flowDirSet->insert(north);
-			oss << "cell " << y << ',' << x << " with no data goes north\n";
-		}
-		if(to[south] < to[west] && to[south] < to[east])
-		{
-			flowDirSet->insert(south);
-			oss << "cell " << y << ',' << x << " with no data goes south\n";
-		}
-		if(to[west] < to[north] && to[west] < to[south])
-		{
-			flowDirSet->insert(west);
-			oss << "cell " << y << ',' << x << " with no data goes west\n";
-		}
-		if(to[east] < to[north] && to[east] < to[south])
-		{
-			flowDirSet->insert(east);
-			oss << "cell " << y << ',' << x << " with no data goes east\n";
-		}
-		if(to[north] == to[west] && x<(cellsX/2))
-		{
-			flowDirSet->insert(northwest);
-			oss << "cell " << y << ',' << x << " with no data goes northwest\n";
-		}
-		if(to[south] == to[east] && x>=(cellsX/2))
-		{
-			flowDirSet->insert(southeast);
-			oss << "cell " << y << ',' << x << " with no data goes southeast\n";
-		}
-		if(to[south] == to[west] && y>=(cellsY/2))
-		{
-			flowDirSet->insert(southwest);
-			oss << "cell " << y << ',' << x << " with no data goes southwest\n";
-		}
-		if(to[north] == to[east] && y<(cellsY/2))
-		{
-			flowDirSet->insert(northeast);
-			oss << "cell " << y << ',' << x << " with no data goes northeast\n";
-		}
-	
-		if(flowDirSet->size())
-		{
-			if(flowDirSet->size()>1) oss << "no data, but multiple directions!\n";
-			//lg.write(debug,oss.str());
-			return *flowDirSet;
-		}
-	}
+void CellGrid::findFlowDirs(int y, FlowDirsKernel kernel, int first, int end)
+{
+	const boost::uint64_t *bits = noData.row(y);
+	const float *up = height.row(y-1), *mid = height.row(y), *down = height.row(y+1);
+	unsigned char *dirSet = flowDirSet.row(y);
 	
-	vector<float> slopes(8,0);
-	switch(method)
+	//the kernel does the runs of cells with data, and the runs without flow off the DEM
+	for(int x = first; x < end; )
 	{
-		//method 2 (compare radial slopes)
-		case direct:
-		slopes[north]		= linear(dem,y,x).height - linear(dem,y-1,x  ).height;
-		slopes[northeast]	= linear(dem,y,x).height - linear(dem,y-1,x+1).height;
-		slopes[east]		= linear(dem,y,x).height - linear(dem,y,  x+1).height;
-		slopes[southeast]	= linear(dem,y,x).height - linear(dem,y+1,x+1).height;
-		slopes[south]		= linear(dem,y,x).height - linear(dem,y+1,x  ).height;
-		slopes[southwest]	= linear(dem,y,x).height - linear(dem,y+1,x-1).height;
-		slopes[west]		= linear(dem,y,x).height - linear(dem,y,  x-1).height;
-		slopes[northwest]	= linear(dem,y,x).height - linear(dem,y-1,x-1).height;
-		break;
-	
-		//method 3 (null)
-		case dummy:
-		slopes[north]		= 0;
-		slopes[northeast]	= 0;
-		slopes[east]		= 0;
-		slopes[southeast]	= 0;
-		slopes[south]		= 1;
-		slopes[southwest]	= 0;
-		slopes[west]		= 0;
-		slopes[northwest]	= 0;
-		break;
-		
-		//method 4 (use lowest elevation)
-		case lowest:
-		slopes[north]		= -linear(dem,y-1,x  ).height;
-		slopes[northeast]	= -linear(dem,y-1,x+1).height;
-		slopes[east]		= -linear(dem,y,  x+1).height;
-		slopes[southeast]	= -linear(dem,y+1,x+1).height;
-		slopes[south]		= -linear(dem,y+1,x  ).height;
-		slopes[southwest]	= -linear(dem,y+1,x-1).height;
-		slopes[west]		= -linear(dem,y,  x-1).height;
-		slopes[northwest]	= -linear(dem,y-1,x-1).height;	
-		break;
+		int run = nextSet(bits, x, end);
+		if(run > x) kernel(up+x, mid+x, down+x, dirSet+x, run-x);
+		x = run;
+		if(x == end) break;
 		
-		//method 1 (rudiger: compare cross slopes)
-		case cross:
-		default:
-		slopes[north]		= linear(dem,y+1,x	).height - linear(dem,y-1,x  ).height;
-		slopes[northeast]	= linear(dem,y+1,x-1).height - linear(dem,y-1,x+1).height;
-		slopes[east]		= linear(dem,y,	 x-1).height - linear(dem,y,  x+1).height;
-		slopes[southeast]	= linear(dem,y-1,x-1).height - linear(dem,y+1,x+1).height;
-		slopes[south]		= -slopes[north];
-		slopes[southwest]	= -slopes[northeast];
-		slopes[west]		= -slopes[east];
-		slopes[northwest]	= -slopes[southeast];
-		break;
-	}
-	
-	float max = *max_element(slopes.begin(),slopes.end());
-	oss.str("");
-	oss << "flowDirs:" << y << ',' << x << " has max slope " << max << '\n';
-	//lg.write(debug, oss.str());
-	for(int dir=north; dir<none; dir++)
-	{
-		if(slopes[dir] == -0) slopes[dir]=0;
-		if(slopes[dir] >= max)
-		{
-			flowDirSet->insert(intDirection(dir));
-			oss.str("");
-			oss << "flowDirs:" << y << ',' << x << " can flow " << intDirection(dir) << '\n';
-			lg.write(debug, oss.str());
-		}
+		run = nextClear(bits, x, end);
+		noDataFlowDirs(y, x, run, dirSet);
+		for(; x < run; x++)
+			if(!dirSet[x]) kernel(up+x, mid+x, down+x, dirSet+x, 1);
 	}
-	
-	if(!flowDirSet->size())
+}
+
+void CellGrid::findNoData(int y)
+{
+	const float *heights = height.row(y);
+	boost::uint64_t *bits = noData.row(y);
+	for(int word = 0; word < noData.width(); word++)
 	{
-		oss.str("");
-		oss << "flowDirs tried to return an empty set for " << y << ',' << x << '\n';
-		lg.write(normal, oss.str());
+		const int first = word*64, last = min(cellsX, first+64);
+		boost::uint64_t mask = 0;
+		for(int x = first; x < last; x++)
+			mask |= (boost::uint64_t)isNoData(heights[x]) << (x-first);
+		bits[word] = mask;
 	}
-	return *flowDirSet;
 }
 
-int Cell::cellsY;
-int Cell::cellsX;
+void CellGrid::setNoDataValue(float value)
+{
+	hasNoDataValue = true;
+	noDataValue = value;
+}
+
+//or the bit into the cells from `from` up to `to`, within the run from x to end
+static void orRange(unsigned char *dirs, int x, int end, int from, int to, direction dir)
+{
+	for(int i = max(x, from); i < min(end, to); i++) dirs[i] |= dirBit(dir);
+}
+
+void CellGrid::noDataFlowDirs(int y, int x, int end, unsigned char *dirs) const
+{
+	/*	Along a row, the distances to the top and bottom edges stay the same,
+		so the nearest edge only changes at a few columns: the run is cut up
+		into ranges that all go the same way.
+	*/
+	const int toNorth = y, toSouth = cellsY-y-1;
+	const int across = min(toNorth, toSouth);	//to the nearer of the two
+	memset(dirs+x, 0, end-x);
+	//nearer the top (bottom) than the left and right: x > toNorth and cellsX-x-1 > toNorth
+	orRange(dirs, x, end, toNorth+1, cellsX-1-toNorth, north);
+	orRange(dirs, x, end, toSouth+1, cellsX-1-toSouth, south);
+	//nearer the left (right) than the top and bottom
+	orRange(dirs, x, end, 0, across, west);
+	orRange(dirs, x, end, cellsX-across, cellsX, east);
+	//exactly as near two edges: the corner between them, on its half of the DEM
+	if(toNorth < cellsX/2)						orRange(dirs, x, end, toNorth, toNorth+1, northwest);
+	if(cellsX-1-toSouth >= cellsX/2)			orRange(dirs, x, end, cellsX-1-toSouth, cellsX-toSouth, southeast);
+	if(y >= cellsY/2)							orRange(dirs, x, end, toSouth, toSouth+1, southwest);
+	if(y < cellsY/2)							orRange(dirs, x, end, cellsX-1-toNorth, cellsX-toNorth, northeast);
+}
 
 direction intDirection(int dirIn)
 {
@@ -375,4 +414,3 @@ direction intDirection(int dirIn)
 	}
 	return none;
 }
-
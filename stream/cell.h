@@ -23,61 +23,154 @@
 #include <cmath>
 
 #include <algorithm>
-#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include "grid.h"
+#include "progress.h"
+#include "scratch.h"
 #include "util.h"
+#include "workqueue.h"
 
 using namespace std;
 
-class Cell;
+class CellGrid;
 
 enum direction{north, northeast, east, southeast, south, southwest, west, northwest, none};
 enum FlowMethod{cross, direct, dummy, lowest};
+//finds the possible flow directions of a run of cells for one FlowMethod; see flowdir.h
+typedef void (*FlowDirsKernel)(const float *up, const float *mid, const float *down,
+								unsigned char *out, int count);
 
 direction intDirection(int dirIn);
 
-extern Cell *dem;
+//Bit representing a direction within a set of possible flow directions.
+inline unsigned char dirBit(int dir) {return (unsigned char)(1 << dir);}
+
 extern Logger lg;
 
-//	Cell represents one space on the DEM.
-class Cell
+/*	CellGrid represents the whole DEM as a structure of arrays: one contiguous
+	array per attribute, indexed by the row-major position of the cell. This
+	keeps the per-cell footprint to a handful of bytes with no per-cell heap
+	allocation or mutex.
+*/
+class CellGrid
 {
 	public:
-	static int cellsY, cellsX;
-		
-	float height;		//Elevation in meters
-	int y,x;			//location of this cell within the DEM
-	unsigned long long flowTotal;
-
-	Cell(float elevation, int y, int x);
-	Cell(float elevation, int y, int x, direction dir);
-	Cell();
-	~Cell();
-	
-	bool getFlowTotalReady() const;
-	unsigned long long getFlowTotal();
-	void setFlowDir(direction dir);
-	direction getFlowDir();
-
-	//fill out the basic data for this cell
-	void fill(float elevation, int y, int x, direction dir = none);
-	/* Calculate and store the flow total for this cell. Cascades out to all
-		cells that flow into this one.
+	int cellsY, cellsX;
+
+	//All the same size and unpadded, so a cell has the same index in each.
+	Grid<float> height;					//Elevation in meters
+	Grid<unsigned char> flowDir;		//the direction in which each cell flows
+	Grid<unsigned char> flowDirSet;		//bitmask of all possible directions; 0 = not found yet
+	Grid<unsigned long long> flowTotal;	//number of cells upstream of each cell
+	//a bit for each cell that has no data, 64 cells to a word; see findNoData()
+	Grid<boost::uint64_t> noData;
+
+	//The elevations are left for the caller to read in.
+	CellGrid(int nYSize, int nXSize);
+
+	long index(int y, int x) const {return height.index(y,x);}
+
+	//fill out the basic data for a cell
+	void fill(int y, int x, direction dir = none);
+	/* Choose the flow direction of every cell that drains off the edge of
+		the DEM, working upstream from each edge cell with an explicit stack.
+		The threads share the work as they go: a thread with idle company
+		hands the oldest part of its stack, the cells nearest the outlet with
+		whole sub-basins left above them, to its queue to be stolen, so one big
+		basin doesn't leave the rest of the threads with nothing to do.
 	*/
-	void accumulate();
-	/* Get all *possible* flow directions for this cell. If a single one has
-		already been chosen, the set only contains that direction.
+	void traceFlowDirs(int threads = 1);
+	/* Calculate and store the flow total of every cell once all the flow
+		directions are chosen. Sweeps downstream from the ridges in a single
+		linear pass, in the manner of Kahn's topological sort. The result does
+		not depend on the number of threads.
 	*/
-	const set<direction>& flowDirs(FlowMethod method = lowest);
-	
+	void accumulate(int threads = 1);
+	/* Bring the flow totals up to date after the flow directions of the
+		given cells changed from oldFlowDir, going over only the cells
+		downstream of them. The other cells must have their totals from
+		before.
+	*/
+	void reaccumulate(const vector<long>& changed, GridView<const unsigned char> oldFlowDir);
+	/* Work out all *possible* flow directions of the interior cells of row y
+		in one pass, as bitmasks. Must be done for every row before any flow
+		directions are resolved. The kernel comes from flowDirsKernel().
+	*/
+	void findFlowDirs(int y, FlowDirsKernel kernel);
+	//the same for the cells of row y from first to before end, once its noData bits are found
+	void findFlowDirs(int y, FlowDirsKernel kernel, int first, int end);
+	/* Set the bits in noData for the cells of row y that have no data, which
+		flow off the nearest edge of the DEM. It's done on the filled heights,
+		so holes in the data within the DEM fill up like any other sink, and
+		only those open to the edge are left. findFlowDirs() does this itself.
+	*/
+	void findNoData(int y);
+	//The band's nodata value. Without one, heights below -500 m have no data.
+	void setNoDataValue(float value);
+
 	private:
-	bool flowTotalReady, accumulated;
-	set<direction>* flowDirSet;	//all possible directions where this cell can flow
-	direction flowDir;	//the direction in which THIS cell flows
-	boost::mutex flowDirs_mutex, accumulate_mutex, getFlowTotal_mutex;
+	//a cell to trace upstream from, starting with its neighbor in direction dir
+	struct TraceTask
+	{
+		long cell;
+		unsigned char dir;
+		bool seed;			//an edge cell, rather than part of another trace
+		TraceTask(long cell = 0, unsigned char dir = north, bool seed = false)
+			: cell(cell), dir(dir), seed(seed) {}
+	};
+	struct TraceWork
+	{
+		WorkQueues<TraceTask> tasks;
+		boost::atomic<long> pending;	//tasks pushed and not yet finished
+		boost::atomic<int> idle;		//threads looking for a task
+		TraceWork(int threads) : tasks(threads), pending(0), idle(0) {}
+	};
+	
+	static const int LOCK_STRIPES = 4096;	//must be a power of 2
+	boost::mutex locks[LOCK_STRIPES];	//shared between cells to guard claims
+
+	boost::mutex& lockFor(long cell) {return locks[cell & (LOCK_STRIPES-1)];}
+	/*	Atomically give the cell at y,x the flow direction dir if that is one of
+		its possible directions and no other direction has been chosen yet.
+	*/
+	bool claim(int y, int x, direction dir);
+	//One thread of traceFlowDirs(). Runs tasks until there are none left.
+	void traceWorker(int worker, TraceWork *work);
+	/*	Follow the path upstream until it's empty, sharing the bottom of it
+		whenever another thread is idle.
+	*/
+	void trace(int worker, TraceWork *work, vector<long>& path, vector<unsigned char>& nextDir);
+	//index of the cell that a cell flows into, or -1 if it leaves the DEM
+	long downstream(long cell) const {return downstream(cell, flowDir[cell]);}
+	//the same for a cell going in the direction dir
+	long downstream(long cell, int dir) const;
+	//total up a cell from the neighbors that flow into it
+	void gatherFlowTotal(long cell);
+	/*	One thread of accumulate(). Takes blocks of rows from the queues and
+		follows each cell downstream for as long as it is the last inflow of
+		the cell below.
+	*/
+	void accumulateRows(int worker, WorkQueues<int> *blocks,
+						boost::atomic<unsigned char> *inflows);
+	bool hasNoDataValue;
+	float noDataValue;
+
+	bool isNoData(float h) const
+	{
+		if(!hasNoDataValue) return h < -500;
+		return h == noDataValue || (noDataValue != noDataValue && h != h);
+	}
+	/*	The directions that take the cells of row y from x to end off the
+		nearest edge of the DEM, into dirs[x] on. It's 0 for the odd cell
+		that is as near one edge as another with no diagonal between them.
+	*/
+	void noDataFlowDirs(int y, int x, int end, unsigned char *dirs) const;
 };
 
 #endif
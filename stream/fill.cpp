@@ -19,27 +19,35 @@
 
 #include "fill.h"
 
-FillSinks::FillSinks(float* linearDem, int nYSize, int nXSize, double minimumSlope)
-	: minslope(minimumSlope), cellsY(nYSize), cellsX(nXSize), pDEM(linearDem)
+//row and column offsets to the neighbor in each direction
+static const int dY[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+static const int dX[8] = { 0, 1, 1, 1, 0, -1, -1, -1};
+
+/*	The order of each of the 8 scans: whether they go along rows (or down
+	columns), and whether the lines and the cells within each line are taken
+	in increasing order.
+*/
+static const bool scanRows[8]		= {true, true, false, false, true, true, false, false};
+static const bool scanLinesUp[8]	= {true, false, false, true, true, false, true, false};
+static const bool scanCellsUp[8]	= {true, false, true, false, false, true, true, false};
+
+//marks a cell that isn't dried out yet
+static const float WET = 50000.0;
+
+FillSinks::FillSinks(GridView<float> dem, double minimumSlope, int threads)
+	: minslope(minimumSlope), cellsY(dem.height()), cellsX(dem.width()), threads(max(threads, 1)),
+	rowsPrepared(0), dem(dem), water(NULL)
 {}
 
-FillSinks::~FillSinks() {}
+FillSinks::~FillSinks()
+{
+	delete water;
+}
 
 void FillSinks::fill()
 {
-	static bool runBefore = false;
-	if(runBefore) return;
-	runBefore = true;
-	
-	bool	something_done;
-	int		x, y, scan, ix, iy, i, it;
-	double	z, wz, wzn;
-	pW		= new float[cellsX*cellsY];
-	pBorder = new int[cellsX*cellsY];
-	
-	//initialize static variable inside linear()
-	linear(pBorder,0,0,cellsX);
-	linear(pW,0,0,cellsX);
+	bool	something_done = false;
+	int		x, y, scanNum, i, it;
 
 	for(i=0; i<8; i++)
 	{
@@ -49,192 +57,170 @@ void FillSinks::fill()
 			epsilon[i] = minslope * 1.41421;
 		else
 			epsilon[i] = minslope;
+		offset[i] = dY[i]*dem.stride() + dX[i];
 	}
 
-	R0[0] = 0; R0[1] = cellsY-1;	R0[2] = 0;			R0[3] = cellsY-1;	R0[4] = 0;			R0[5] = cellsY-1;	R0[6] = 0; R0[7] = cellsY-1;
-	C0[0] = 0; C0[1] = cellsX-1;	C0[2] = cellsX-1;	C0[3] = 0;			C0[4] = cellsX-1;	C0[5] = 0;			C0[6] = 0; C0[7] = cellsX-1;
-	dR[0] = 0; dR[1] = 0;			dR[2] = 1;			dR[3] = -1;			dR[4] = 0;			dR[5] = 0;			dR[6] = 1; dR[7] = -1;
-	dC[0] = 1; dC[1] = -1;			dC[2] = 0;			dC[3] = 0;			dC[4] = -1;			dC[5] = 1;			dC[6] = 0; dC[7] = 0;
-	fR[0] = 1; fR[1] = -1;			fR[2] = -cellsY+1;	fR[3] = cellsY-1;	fR[4] = 1;			fR[5] = -1;			fR[6] = -cellsY+1; fR[7] = cellsY-1;
-	fC[0] = -cellsX+1, fC[1] = cellsX-1; fC[2] = -1;	fC[3] = 1;			fC[4] = cellsX-1;	fC[5] = -cellsX+1;	fC[6] = 1; fC[7] = -1;
-
-	initAltitude();															// Stage 1
+	prepareRows(rowsPrepared, cellsY);										// Stage 1
 
+	vector<long> stack;
 	for(x=0; x<cellsX; x++)													// Stage 2, Section 1
 	{
 		for(y=0; y<cellsY; y++)
 		{
-			if(linear(pBorder, y, x) == 1 )
-				dryUpwardCell(x, y);
+			if(y == 0 || x == 0 || y == cellsY-1 || x == cellsX-1)
+				dryUpwardCell(y, x, 0, cellsY, true, stack);
 		}
 	}
 	for(it=0; it<1000; it++)
 	{
-		for(scan=0; scan<8; scan++)					// Stage 2, Section 2
+		for(scanNum=0; scanNum<8; scanNum++)								// Stage 2, Section 2
 		{
-			R = R0[scan];
-			C = C0[scan];
-			something_done = false;
-
-			do 
-			{
-				if((wz = linear(pW, R, C)) > (z = linear(pDEM, R, C)))
-				{
-					for(i=0; i<8; i++)
-					{
-						ix	= neighborX(i, C);
-						iy	= neighborY(i, R);	
-
-						if(ix>=0 && iy>=0 && ix<cellsX && iy<cellsY)
-						{
-							if( z >= (wzn = (linear(pW, iy, ix) + epsilon[i])) )	// operation 1
-							{
-								linear(pW, R, C) = z;
-								something_done = true;
-								dryUpwardCell(C, R);
-								break;
-							}
-							if( wz > wzn )											// operation 2
-							{
-								linear(pW, R, C) = wzn;
-								something_done = true;
-							}
-						}
-					}
-				}
-			}while(nextCell(scan));
+			something_done = scan(scanNum);
 			if(something_done == false) break;
 		}
 		if(something_done == false) break;
 	}
 
-	for(long long count = 0; count < cellsX*cellsY; count++) pDEM[count] = pW[count];
+	for(y=0; y<cellsY; y++) copy(water->row(y), water->row(y)+cellsX, dem.row(y));
 
-	delete pW;
-	delete pBorder;
+	//a fill after this one prepares every row again
+	delete water;
+	water = NULL;
+	rowsPrepared = 0;
 
 	return;
 }
 
-void FillSinks::dryUpwardCell(int x, int y)
+bool FillSinks::scan(int scan)
 {
-	int const	MAX_DEPTH = 32000;	//arbitrary limit to prevent runaway recursion
-	int			depth = 0;
-	int			ix, iy, i;
-	double		zn;
-
-	depth += 1;
+	int lines = scanRows[scan] ? cellsY : cellsX;
+	int count = min(threads*2, lines);
+	strips.resize(count);
+	for(int i=0; i<count; i++)
+	{
+		strips[i].first = (long)lines * i / count;
+		strips[i].end = (long)lines * (i+1) / count;
+	}
+	
+	//the even strips, then the odd ones
+	scanStrips(scan, 0);
+	scanStrips(scan, 1);
 	
-	if( depth <= MAX_DEPTH )
+	bool something_done = false;
+	for(int i=0; i<count; i++) something_done |= strips[i].somethingDone;
+	return something_done;
+}
+
+void FillSinks::scanStrips(int scan, unsigned int firstStrip)
+{
+	boost::thread_group scanners;
+	for(unsigned int i=firstStrip; i<strips.size(); i+=2)
 	{
-		for(i=0; i<8; i++)
-		{
-			ix	= neighborX(i, x);		
-			iy	= neighborY(i, y);	
-			
-			if(ix>=0 && iy>=0 && ix<cellsX && iy<cellsY && linear(pW, iy, ix) == 50000 )
-			{
-				if( (zn = linear(pDEM, iy, ix)) >= (linear(pW, y, x) + epsilon[i]) )
-				{
-					linear(pW, iy, ix) = zn;
-					dryUpwardCell(ix, iy);
-				}
-			}
-		}
+		if(i+2 < strips.size())
+			scanners.add_thread(new boost::thread(&FillSinks::scanStrip, this, scan,
+													boost::ref(strips[i])));
+		else
+			scanStrip(scan, strips[i]);
 	}
-	depth -= 1;
+	scanners.join_all();
 }
 
-void FillSinks::initAltitude()
+void FillSinks::scanStrip(int scan, Strip& strip)
 {
-	bool	border;
-	int		x, y, i, ix, iy;
-	for(x=0; x<cellsX; x++)
+	bool rows = scanRows[scan];
+	int lineCells = rows ? cellsX : cellsY;
+	vector<long> stack;
+	strip.somethingDone = false;
+	for(int line = 0; line < strip.end-strip.first; line++)
 	{
-		for(y=0; y<cellsY; y++)
+		int l = scanLinesUp[scan] ? strip.first+line : strip.end-1-line;
+		for(int c = 0; c < lineCells; c++)
 		{
-			border = false;
-			for(i=0; i<8; i++)
-			{
-				ix	= neighborX(i, x);
-				iy	= neighborY(i, y);
-				if(ix<0 || iy<0 || ix>=cellsX || iy>=cellsY)
-				{
-					border = true;
-					break;
-				}
-			}
-
-			if( border == true )
-			{
-				linear(pBorder, y, x) = 1;
-				linear(pW, y, x) = linear(pDEM, y, x);
-			}
-			else
-			{
-				linear(pW, y, x) = 50000.0;
-			}
+			int p = scanCellsUp[scan] ? c : lineCells-1-c;
+			if(rows ? scanCell(l, p, strip.first, strip.end, rows, stack)
+					: scanCell(p, l, strip.first, strip.end, rows, stack))
+				strip.somethingDone = true;
 		}
 	}
-}	
+}
 
-bool FillSinks::nextCell(int i)
+bool FillSinks::scanCell(int y, int x, int first, int end, bool rows, vector<long>& stack)
 {
-	R = R + dR[i];
-	C = C + dC[i];
-
-	if( R < 0 || C < 0 || R >= cellsY || C >= cellsX )
+	Grid<float>& W = *water;
+	long	cell = dem.index(y,x);
+	double	z = dem[cell], wz = W[cell], wzn;
+	bool	something_done = false;
+	if(wz <= z) return false;
+	
+	//cells on the edge of the DEM have to check that each neighbor exists
+	bool	inside = y > 0 && x > 0 && y < cellsY-1 && x < cellsX-1;
+	for(int i=0; i<8; i++)
 	{
-		R = R + fR[i];
-		C = C + fC[i];
-		if( R < 0 || C < 0 || R >= cellsY || C >= cellsX )
-			return false;
+		if(!inside)
+		{
+			int iy = y + dY[i], ix = x + dX[i];
+			if(iy<0 || ix<0 || iy>=cellsY || ix>=cellsX) continue;
+		}
+		wzn = W[cell+offset[i]] + epsilon[i];
+		if( z >= wzn )														// operation 1
+		{
+			W[cell] = z;
+			dryUpwardCell(y, x, first, end, rows, stack);
+			return true;
+		}
+		if( wz > wzn )															// operation 2
+		{
+			W[cell] = wzn;
+			wz = W[cell];
+			something_done = true;
+		}
 	}
-	return true;
+	return something_done;
 }
 
-int FillSinks::neighborX(int direction, int column)
+void FillSinks::dryUpwardCell(int y, int x, int first, int end, bool rows, vector<long>& stack)
 {
-	switch(direction)
+	Grid<float>& W = *water;
+	stack.push_back(dem.index(y,x));
+	while(!stack.empty())
 	{
-		case 0:
-		case 4:
-		return column;
-		
-		case 1:
-		case 2:
-		case 3:
-		return column+1;
+		long cell = stack.back();
+		stack.pop_back();
+		y = cell / dem.stride();
+		x = cell % dem.stride();
+		for(int i=0; i<8; i++)
+		{
+			int iy = y + dY[i], ix = x + dX[i];
+			if(iy<0 || ix<0 || iy>=cellsY || ix>=cellsX) continue;
+			//stay within the strip that this thread is scanning
+			int line = rows ? iy : ix;
+			if(line < first || line >= end) continue;
 			
-		case 5:
-		case 6:
-		case 7:
-		return column-1;
-		
-		default:
-		return -1;
+			long next = cell + offset[i];
+			double zn;
+			if(W[next] == WET && (zn = dem[next]) >= (W[cell] + epsilon[i]))
+			{
+				W[next] = zn;
+				stack.push_back(next);
+			}
+		}
 	}
 }
 
-int FillSinks::neighborY(int direction, int row)
+void FillSinks::prepareRows(int first, int end)
 {
-	switch(direction)
+	if(!water) water = new Grid<float>(cellsY, dem.stride());
+	for(int y=first; y<end; y++)
 	{
-		case 2:
-		case 6:
-		return row;
-		
-		case 3:
-		case 4:
-		case 5:
-		return row+1;
-			
-		case 0:
-		case 1:
-		case 7:
-		return row-1;
-		
-		default:
-		return -1;
+		const float *z = dem.row(y);
+		float *w = water->row(y);
+		for(int x=0; x<cellsX; x++)
+		{
+			if(y == 0 || x == 0 || y == cellsY-1 || x == cellsX-1)
+				w[x] = z[x];
+			else
+				w[x] = WET;
+		}
 	}
+	rowsPrepared = end;
 }
@@ -20,6 +20,9 @@
 #ifndef FILLSINKS_H
 #define FILLSINKS_H
 
+#include <vector>
+
+#include "grid.h"
 #include "util.h"
 
 using namespace std;
@@ -31,27 +34,51 @@ extern Logger lg;
 	"A fast, simple and versatile algorithm to fill the depressions of digital
 	elevation models."
 	Catena 46: 159-176
+	Each of the scans runs as a parallel wavefront: the DEM is cut into strips
+	across the direction of the scan, and every other strip is scanned at once
+	so that no two threads touch neighboring cells.
 */
 class FillSinks
 {
 	public:
-	FillSinks(float* linearDem, int nYSize, int nXSize, double minimumSlope = 0);
+	//fills the cells of the given grid in place
+	FillSinks(GridView<float> dem, double minimumSlope = 0, int threads = 1);
 	~FillSinks();
+	/*	Set up the given rows for filling, for instance while the rest of the
+		DEM is still being read. Rows must be prepared in order.
+	*/
+	void prepareRows(int first, int end);
 	void fill();
-	static int neighborX(int direction, int column);
-	static int neighborY(int direction, int row);
 	
 	private:
+	//lines of the DEM in a strip of a scan, across the direction of the scan
+	struct Strip
+	{
+		int first, end;
+		bool somethingDone;
+	};
+	
 	double minslope;
-	int cellsY, cellsX;
+	int cellsY, cellsX, threads;
+	int rowsPrepared;
 	
-	int			R, C, R0[8], C0[8], dR[8], dC[8], fR[8], fC[8];
 	double		epsilon[8];
-	float		*pW, *pDEM;
-	int 		*pBorder;
-	bool		nextCell(int i);
-	void		initAltitude();
-	void		dryUpwardCell(int x, int y);
+	long		offset[8];	//distance in the grids to the neighbor in each direction
+	GridView<float> dem;
+	Grid<float>	*water;		//the water surface, W; laid out just like dem
+	vector<Strip> strips;
+	
+	//runs one of the 8 scans over the whole DEM. Returns true if it changed anything
+	bool		scan(int scan);
+	//scans every other strip, starting with the given one, in parallel
+	void		scanStrips(int scan, unsigned int firstStrip);
+	void		scanStrip(int scan, Strip& strip);
+	//apply both operations of the algorithm to a cell. Returns true if it changed
+	bool		scanCell(int y, int x, int first, int end, bool rows, vector<long>& stack);
+	/*	Dry out every cell upstream of the cell at y,x. Only goes into cells with
+		their row (or column, if rows is false) from first to before end.
+	*/
+	void		dryUpwardCell(int y, int x, int first, int end, bool rows, vector<long>& stack);
 };
 
 #endif
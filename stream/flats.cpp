@@ -0,0 +1,176 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "flats.h"
+
+//row and column offsets to the neighbor in each direction
+static const int dY[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+static const int dX[8] = { 0, 1, 1, 1, 0, -1, -1, -1};
+
+FlatResolver::FlatResolver(GridView<float> dem, GridView<unsigned char> flowDirSets,
+							GridView<boost::uint64_t> noData)
+	: cellsY(dem.height()), cellsX(dem.width()), dem(dem),
+	flowDirSets(flowDirSets), noData(noData)
+{}
+
+bool FlatResolver::isFlat(int y, int x) const
+{
+	if(y < 1 || x < 1 || y >= cellsY-1 || x >= cellsX-1 || hasNoData(y,x)) return false;
+	const float h = dem(y,x);
+	for(int dir=north; dir<none; dir++)
+		if(dem(y+dY[dir], x+dX[dir]) < h) return false;
+	return true;
+}
+
+bool FlatResolver::besideKind(const Grid<unsigned char>& kind, long cell, unsigned char of) const
+{
+	const int y = cell / cellsX, x = cell % cellsX;
+	for(int dir=north; dir<none; dir++)
+	{
+		int ny = y + dY[dir], nx = x + dX[dir];
+		if(kind.contains(ny,nx) && kind(ny,nx) == of && dem(ny,nx) == dem(y,x))
+			return true;
+	}
+	return false;
+}
+
+unsigned char FlatResolver::firstWithData(int y, int x, unsigned char dirs) const
+{
+	for(int dir=north; dir<none; dir++)
+		if((dirs & dirBit(dir)) && !hasNoData(y+dY[dir], x+dX[dir]))
+			return dirBit(dir);
+	return dirs;
+}
+
+long FlatResolver::resolve()
+{
+	Grid<unsigned char> kind(cellsY, cellsX);
+	Grid<int> mask(cellsY, cellsX);		//the number that leads the water off a flat
+	long flats = 0;
+	for(int y = 0; y < cellsY; y++)
+	{
+		for(int x = 0; x < cellsX; x++)
+		{
+			kind(y,x) = isFlat(y,x) ? flat : other;
+			mask(y,x) = 0;
+			if(kind(y,x) == flat) flats++;
+		}
+	}
+
+	//the edges of the flats
+	vector<long> highEdges, lowEdges;
+	for(int y = 0; y < cellsY; y++)
+	{
+		for(int x = 0; x < cellsX; x++)
+		{
+			const long cell = (long)y*cellsX + x;
+			if(kind(y,x) == other)
+			{
+				if(!hasNoData(y,x) && besideKind(kind, cell, flat)) lowEdges.push_back(cell);
+				continue;
+			}
+			for(int dir=north; dir<none; dir++)
+			{
+				int ny = y + dY[dir], nx = x + dX[dir];
+				if(dem(ny,nx) > dem(y,x) && !hasNoData(ny,nx))
+				{
+					highEdges.push_back(cell);
+					break;
+				}
+			}
+		}
+	}
+
+	/*	Away from the high ground: the number of rings out from a high edge,
+		turned around so it gets smaller further away. It goes up by at most one
+		from a cell to its neighbor, so the gradient toward the low edges, which
+		goes up by two, always wins.
+	*/
+	vector<long> ring, next;
+	int rings = 0;
+	for(size_t i = 0; i < highEdges.size(); i++) mask[highEdges[i]] = 1;
+	ring.swap(highEdges);
+	while(!ring.empty())
+	{
+		rings++;
+		for(size_t i = 0; i < ring.size(); i++)
+		{
+			const int y = ring[i] / cellsX, x = ring[i] % cellsX;
+			for(int dir=north; dir<none; dir++)
+			{
+				int ny = y + dY[dir], nx = x + dX[dir];
+				if(kind(ny,nx) != flat || mask(ny,nx) != 0 || dem(ny,nx) != dem(y,x)) continue;
+				mask(ny,nx) = rings + 1;
+				next.push_back((long)ny*cellsX + nx);
+			}
+		}
+		ring.swap(next);
+		next.clear();
+	}
+	for(long cell = 0; cell < mask.size(); cell++)
+		if(mask[cell] != 0) mask[cell] = rings - mask[cell];
+
+	//toward the low edges, which count as ring 0, two for each ring
+	ring.swap(lowEdges);
+	for(int distance = 1; !ring.empty(); distance++)
+	{
+		for(size_t i = 0; i < ring.size(); i++)
+		{
+			const int y = ring[i] / cellsX, x = ring[i] % cellsX;
+			for(int dir=north; dir<none; dir++)
+			{
+				int ny = y + dY[dir], nx = x + dX[dir];
+				if(!kind.contains(ny,nx) || kind(ny,nx) != flat || dem(ny,nx) != dem(y,x)) continue;
+				kind(ny,nx) = drained;
+				mask(ny,nx) += 2*distance;
+				next.push_back((long)ny*cellsX + nx);
+			}
+		}
+		ring.swap(next);
+		next.clear();
+	}
+
+	for(int y = 1; y < cellsY-1; y++)
+	{
+		for(int x = 1; x < cellsX-1; x++)
+		{
+			unsigned char& dirs = flowDirSets(y,x);
+			if(kind(y,x) != drained)
+			{
+				dirs = firstWithData(y, x, dirs);
+				continue;
+			}
+			//down the numbers, to the low edge in the end; low edges count as 0
+			int lowest = mask(y,x), way = none;
+			for(int dir=north; dir<none; dir++)
+			{
+				int ny = y + dY[dir], nx = x + dX[dir];
+				if(dem(ny,nx) != dem(y,x) || hasNoData(ny,nx) || kind(ny,nx) == flat) continue;
+				int number = (kind(ny,nx) == drained) ? mask(ny,nx) : 0;
+				if(number < lowest)
+				{
+					lowest = number;
+					way = dir;
+				}
+			}
+			if(way != none) dirs = dirBit(way);
+		}
+	}
+	return flats;
+}
@@ -0,0 +1,89 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLATS_H
+#define FLATS_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "cell.h"
+#include "grid.h"
+
+using namespace std;
+
+/*	This way of draining flats is an implementation of:
+	Barnes, R., C. Lehman & D. Mulla (2014):
+	"An efficient assignment of drainage direction over flat surfaces in
+	raster digital elevation models."
+	Computers & Geosciences 62: 128-135
+	A flat is a patch of interior cells of one height with no lower neighbor,
+	like the ones filling leaves. Its low edges are the cells of the same
+	height around it that do drain, and its high edges the cells of it next
+	to higher ground. One breadth-first pass out from the high edges and one
+	from the low edges give each cell of the flat a number that gets smaller
+	toward the low edges and, among cells just as far from them, away from the
+	high ground. Every flat cell then flows to its neighbor with the smallest
+	number, so the water on a flat takes one way out, down the middle, and not
+	whichever way the trace happened to reach it.
+*/
+class FlatResolver
+{
+	public:
+	//All laid out alike; see CellGrid.
+	FlatResolver(GridView<float> dem, GridView<unsigned char> flowDirSets,
+					GridView<boost::uint64_t> noData);
+	/*	Leave every interior cell with exactly one possible flow direction:
+		the way off its flat for a flat cell that drains, and one of its
+		possible directions for any other (see firstWithData()). Returns the
+		number of flat cells.
+	*/
+	long resolve();
+	//whether the cell is on a flat: inside the DEM, with data, and no lower neighbor
+	bool isFlat(int y, int x) const;
+
+	private:
+	enum Kind
+	{
+		other,
+		flat,		//not yet reached from a low edge
+		drained		//reached from a low edge, so its number is final
+	};
+
+	int cellsY, cellsX;
+	GridView<float> dem;
+	GridView<unsigned char> flowDirSets;
+	GridView<boost::uint64_t> noData;
+
+	bool hasNoData(int y, int x) const
+	{
+		return (noData.row(y)[x/64] >> (x%64)) & 1;
+	}
+	//whether the cell is the same height as a neighbor that is one of the kind
+	bool besideKind(const Grid<unsigned char>& kind, long cell, unsigned char of) const;
+	/*	The first of the directions that leads to a cell with data. The ways
+		off the DEM through cells without data don't always agree with the
+		data, so if there is none, all of them are kept for the trace to
+		choose from.
+	*/
+	unsigned char firstWithData(int y, int x, unsigned char dirs) const;
+};
+
+#endif
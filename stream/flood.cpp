@@ -0,0 +1,292 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "flood.h"
+
+//row and column offsets to the neighbor in each direction
+static const int dY[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+static const int dX[8] = { 0, 1, 1, 1, 0, -1, -1, -1};
+
+PriorityFlood::PriorityFlood(GridView<float> dem, double minimumSlope)
+	: minslope(minimumSlope), cellsY(dem.height()), cellsX(dem.width()), dem(dem)
+{
+	for(int i=0; i<8; i++)
+	{
+		//diagonal cells are slightly more distant than N,S,E,W neighbors, so
+		//an equal slope gives a greater elevation difference.
+		if(i%2)
+			epsilon[i] = minslope * 1.41421;
+		else
+			epsilon[i] = minslope;
+	}
+}
+
+void PriorityFlood::fill(GridView<unsigned char> flowDirs)
+{
+	vector<bool> closed(cellsY*dem.stride(), false);
+	priority_queue<Entry, vector<Entry>, greater<Entry> > open;
+	queue<long> pit;
+	
+	//the water starts at the edge of the DEM
+	for(int y=0; y<cellsY; y++)
+	{
+		int step = (y == 0 || y == cellsY-1) ? 1 : cellsX-1;
+		for(int x=0; x<cellsX; x+=step)
+		{
+			long cell = dem.index(y,x);
+			closed[cell] = true;
+			open.push(Entry(dem[cell], cell));
+		}
+	}
+	
+	while(!open.empty() || !pit.empty())
+	{
+		long cell;
+		if(!pit.empty())
+		{
+			cell = pit.front();
+			pit.pop();
+		}else{
+			cell = open.top().second;
+			open.pop();
+		}
+		int y = cell / dem.stride(), x = cell % dem.stride();
+		double z = dem[cell];
+		for(int i=0; i<8; i++)
+		{
+			int iy = y + dY[i], ix = x + dX[i];
+			if(!dem.contains(iy, ix)) continue;
+			long next = dem.index(iy,ix);
+			if(closed[next]) continue;
+			closed[next] = true;
+			//it drains back the way the water came in
+			if(flowDirs.data()) flowDirs[next] = (i+4)%8;
+			if(dem[next] <= z + epsilon[i])
+			{
+				//a sink (or flat): raise it to the water level
+				dem[next] = z + epsilon[i];
+				pit.push(next);
+			}else{
+				open.push(Entry(dem[next], next));
+			}
+		}
+	}
+}
+
+//rows in a strip of the tiled flood, at least
+static const int MIN_STRIP_ROWS = 16;
+
+TiledFlood::TiledFlood(GridView<float> dem, int threads)
+	: cellsY(dem.height()), cellsX(dem.width()), threads(max(threads, 1)), dem(dem),
+	stripQueue(NULL)
+{}
+
+void TiledFlood::fill()
+{
+	//a few strips per thread evens out the load
+	int count = max(1, min(threads*4, cellsY / MIN_STRIP_ROWS));
+	strips.resize(count);
+	int label = 1;	//label 0 is not used
+	for(int i=0; i<count; i++)
+	{
+		Strip& strip = strips[i];
+		strip.first = (long)cellsY * i / count;
+		strip.end = (long)cellsY * (i+1) / count;
+		strip.firstLabel = label;
+		int rows = strip.end - strip.first;
+		label += (rows == 1) ? cellsX : 2*cellsX + 2*(rows-2);
+	}
+	level.assign(label, numeric_limits<float>::infinity());
+	labels = GridView<int>(Scratch::allocate<int>(cellsY*dem.stride()), cellsY, dem.stride());
+	fill_n(labels.data(), labels.size(), 0);
+	
+	runStrips(&TiledFlood::floodStrips);
+	floodLabels();
+	runStrips(&TiledFlood::applyStrips);
+	
+	Scratch::release(labels.data());
+	labels = GridView<int>();
+	strips.clear();
+}
+
+void TiledFlood::runStrips(void (TiledFlood::*work)(int))
+{
+	WorkQueues<int> pending(threads);
+	for(unsigned int i=0; i<strips.size(); i++) pending.push(i % threads, i);
+	stripQueue = &pending;
+	boost::thread_group workers;
+	for(int worker = 1; worker < threads; worker++)
+		workers.add_thread(new boost::thread(work, this, worker));
+	(this->*work)(0);
+	workers.join_all();
+	stripQueue = NULL;
+}
+
+void TiledFlood::floodStrips(int worker)
+{
+	int strip;
+	while(stripQueue->pop(worker, strip))
+	{
+		floodStrip(strips[strip]);
+		Progress::advance((long long)(strips[strip].end - strips[strip].first)*cellsX);
+	}
+}
+
+void TiledFlood::applyStrips(int worker)
+{
+	int strip;
+	while(stripQueue->pop(worker, strip)) applyStrip(strips[strip]);
+}
+
+void TiledFlood::addSpill(SpillMap& spills, int a, int b, float z)
+{
+	pair<int,int> key(min(a,b), max(a,b));
+	SpillMap::iterator spill = spills.find(key);
+	if(spill == spills.end())
+		spills[key] = z;
+	else if(z < spill->second)
+		spill->second = z;
+}
+
+void TiledFlood::floodStrip(Strip& strip)
+{
+	priority_queue<Entry, vector<Entry>, greater<Entry> > open;
+	queue<long> pit;
+	
+	//the water starts at the edge of the strip, with a label for each cell
+	int label = strip.firstLabel;
+	for(int y=strip.first; y<strip.end; y++)
+	{
+		int step = (y == strip.first || y == strip.end-1) ? 1 : cellsX-1;
+		for(int x=0; x<cellsX; x+=step)
+		{
+			long cell = dem.index(y,x);
+			labels[cell] = label++;
+			open.push(Entry(dem[cell], cell));
+		}
+	}
+	
+	while(!open.empty() || !pit.empty())
+	{
+		long cell;
+		if(!pit.empty())
+		{
+			cell = pit.front();
+			pit.pop();
+		}else{
+			cell = open.top().second;
+			open.pop();
+		}
+		int y = cell / dem.stride(), x = cell % dem.stride();
+		float z = dem[cell];
+		for(int i=0; i<8; i++)
+		{
+			int iy = y + dY[i], ix = x + dX[i];
+			if(iy<strip.first || ix<0 || iy>=strip.end || ix>=cellsX) continue;
+			long next = dem.index(iy,ix);
+			if(labels[next])
+			{
+				//already flooded: where two labels meet, water can spill across
+				if(labels[next] != labels[cell])
+					addSpill(strip.spills, labels[cell], labels[next], max(z, dem[next]));
+				continue;
+			}
+			labels[next] = labels[cell];
+			if(dem[next] <= z)
+			{
+				dem[next] = z;
+				pit.push(next);
+			}else{
+				open.push(Entry(dem[next], next));
+			}
+		}
+	}
+}
+
+void TiledFlood::floodLabels()
+{
+	//link up the labels, including across the boundaries between strips
+	vector< vector< pair<int,float> > > links(level.size());
+	for(unsigned int i=0; i<strips.size(); i++)
+	{
+		if(i > 0)
+		{
+			long above = dem.index(strips[i].first-1, 0), below = dem.index(strips[i].first, 0);
+			for(int x=0; x<cellsX; x++)
+			{
+				for(int ix = max(x-1, 0); ix <= min(x+1, cellsX-1); ix++)
+				{
+					addSpill(strips[i].spills, labels[above+x], labels[below+ix],
+								max(dem[above+x], dem[below+ix]));
+				}
+			}
+		}
+		for(SpillMap::iterator spill = strips[i].spills.begin();
+			spill != strips[i].spills.end(); ++spill)
+		{
+			links[spill->first.first].push_back(make_pair(spill->first.second, spill->second));
+			links[spill->first.second].push_back(make_pair(spill->first.first, spill->second));
+		}
+		strips[i].spills.clear();
+	}
+	
+	//water leaves through the labels on the edge of the DEM at no extra height
+	typedef pair<float,int> LabelEntry;
+	priority_queue<LabelEntry, vector<LabelEntry>, greater<LabelEntry> > open;
+	for(unsigned int i=0; i<strips.size(); i++)
+	{
+		for(int y=strips[i].first; y<strips[i].end; y++)
+		{
+			int step = (y == 0 || y == cellsY-1) ? 1 : cellsX-1;
+			for(int x=0; x<cellsX; x+=step)
+			{
+				int label = labels[dem.index(y,x)];
+				level[label] = -numeric_limits<float>::infinity();
+				open.push(LabelEntry(level[label], label));
+			}
+		}
+	}
+	while(!open.empty())
+	{
+		LabelEntry top = open.top();
+		open.pop();
+		if(top.first > level[top.second]) continue;	//already lowered
+		for(unsigned int i=0; i<links[top.second].size(); i++)
+		{
+			int next = links[top.second][i].first;
+			float spill = max(top.first, links[top.second][i].second);
+			if(spill < level[next])
+			{
+				level[next] = spill;
+				open.push(LabelEntry(spill, next));
+			}
+		}
+	}
+}
+
+void TiledFlood::applyStrip(const Strip& strip)
+{
+	for(int y = strip.first; y < strip.end; y++)
+	{
+		float *z = dem.row(y);
+		const int *label = labels.row(y);
+		for(int x = 0; x < cellsX; x++)
+			if(z[x] < level[label[x]]) z[x] = level[label[x]];
+	}
+}
@@ -0,0 +1,239 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "flowdir.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOWDIR_X86
+#include <immintrin.h>
+#endif
+
+/*	Scalar version, used for the cells left over at the end of a row and on
+	processors without vector units. The neighbors are in direction order.
+	The kernels all take the method as a template parameter, so the switches on
+	it are settled when they're compiled.
+*/
+template<FlowMethod method>
+static unsigned char flowDirsCell(const float *up, const float *mid, const float *down)
+{
+	float h[8] = {up[0], up[1], mid[1], down[1], down[0], down[-1], mid[-1], up[-1]};
+	float slopes[8];
+	switch(method)
+	{
+		//method 2 (compare radial slopes)
+		case direct:
+		for(int dir=north; dir<none; dir++) slopes[dir] = mid[0] - h[dir];
+		break;
+	
+		//method 3 (null)
+		case dummy:
+		return dirBit(south);
+		
+		//method 4 (use lowest elevation)
+		case lowest:
+		for(int dir=north; dir<none; dir++) slopes[dir] = -h[dir];
+		break;
+		
+		//method 1 (rudiger: compare cross slopes)
+		case cross:
+		default:
+		slopes[north]		= h[south] - h[north];
+		slopes[northeast]	= h[southwest] - h[northeast];
+		slopes[east]		= h[west] - h[east];
+		slopes[southeast]	= h[northwest] - h[southeast];
+		slopes[south]		= -slopes[north];
+		slopes[southwest]	= -slopes[northeast];
+		slopes[west]		= -slopes[east];
+		slopes[northwest]	= -slopes[southeast];
+		break;
+	}
+	
+	float max = *max_element(slopes, slopes+8);
+	unsigned char dirs = 0;
+	for(int dir=north; dir<none; dir++)
+		if(slopes[dir] >= max) dirs |= dirBit(dir);
+	return dirs;
+}
+
+#ifdef FLOWDIR_X86
+
+/*	The vector kernels follow the scalar one exactly: the same slopes are
+	calculated with the same operations, then every direction whose slope
+	reaches the maximum sets its bit. No branches depend on the data.
+*/
+template<FlowMethod method>
+__attribute__((target("avx2")))
+static int flowDirsAVX2(const float *up, const float *mid, const float *down,
+						unsigned char *out, int count)
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	int i = 0;
+	for(; i+8 <= count; i+=8)
+	{
+		__m256 s[8];
+		__m256 h[8];
+		h[north]	= _mm256_loadu_ps(up+i);
+		h[northeast]= _mm256_loadu_ps(up+i+1);
+		h[east]		= _mm256_loadu_ps(mid+i+1);
+		h[southeast]= _mm256_loadu_ps(down+i+1);
+		h[south]	= _mm256_loadu_ps(down+i);
+		h[southwest]= _mm256_loadu_ps(down+i-1);
+		h[west]		= _mm256_loadu_ps(mid+i-1);
+		h[northwest]= _mm256_loadu_ps(up+i-1);
+		switch(method)
+		{
+			case direct:
+			{
+				__m256 c = _mm256_loadu_ps(mid+i);
+				for(int dir=north; dir<none; dir++) s[dir] = _mm256_sub_ps(c, h[dir]);
+				break;
+			}
+			case lowest:
+			for(int dir=north; dir<none; dir++) s[dir] = _mm256_xor_ps(h[dir], sign);
+			break;
+			
+			case cross:
+			default:
+			s[north]	= _mm256_sub_ps(h[south], h[north]);
+			s[northeast]= _mm256_sub_ps(h[southwest], h[northeast]);
+			s[east]		= _mm256_sub_ps(h[west], h[east]);
+			s[southeast]= _mm256_sub_ps(h[northwest], h[southeast]);
+			s[south]	= _mm256_xor_ps(s[north], sign);
+			s[southwest]= _mm256_xor_ps(s[northeast], sign);
+			s[west]		= _mm256_xor_ps(s[east], sign);
+			s[northwest]= _mm256_xor_ps(s[southeast], sign);
+			break;
+		}
+		__m256 max = _mm256_max_ps(_mm256_max_ps(_mm256_max_ps(s[0], s[1]), _mm256_max_ps(s[2], s[3])),
+									_mm256_max_ps(_mm256_max_ps(s[4], s[5]), _mm256_max_ps(s[6], s[7])));
+		__m256i dirs = _mm256_setzero_si256();
+		for(int dir=north; dir<none; dir++)
+		{
+			__m256i hit = _mm256_castps_si256(_mm256_cmp_ps(s[dir], max, _CMP_GE_OQ));
+			dirs = _mm256_or_si256(dirs, _mm256_and_si256(hit, _mm256_set1_epi32(dirBit(dir))));
+		}
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(dirs), _mm256_extracti128_si256(dirs, 1));
+		_mm_storel_epi64((__m128i*)(out+i), _mm_packus_epi16(words, words));
+	}
+	return i;
+}
+
+template<FlowMethod method>
+__attribute__((target("sse2")))
+static int flowDirsSSE2(const float *up, const float *mid, const float *down,
+						unsigned char *out, int count)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	int i = 0;
+	for(; i+4 <= count; i+=4)
+	{
+		__m128 s[8];
+		__m128 h[8];
+		h[north]	= _mm_loadu_ps(up+i);
+		h[northeast]= _mm_loadu_ps(up+i+1);
+		h[east]		= _mm_loadu_ps(mid+i+1);
+		h[southeast]= _mm_loadu_ps(down+i+1);
+		h[south]	= _mm_loadu_ps(down+i);
+		h[southwest]= _mm_loadu_ps(down+i-1);
+		h[west]		= _mm_loadu_ps(mid+i-1);
+		h[northwest]= _mm_loadu_ps(up+i-1);
+		switch(method)
+		{
+			case direct:
+			{
+				__m128 c = _mm_loadu_ps(mid+i);
+				for(int dir=north; dir<none; dir++) s[dir] = _mm_sub_ps(c, h[dir]);
+				break;
+			}
+			case lowest:
+			for(int dir=north; dir<none; dir++) s[dir] = _mm_xor_ps(h[dir], sign);
+			break;
+			
+			case cross:
+			default:
+			s[north]	= _mm_sub_ps(h[south], h[north]);
+			s[northeast]= _mm_sub_ps(h[southwest], h[northeast]);
+			s[east]		= _mm_sub_ps(h[west], h[east]);
+			s[southeast]= _mm_sub_ps(h[northwest], h[southeast]);
+			s[south]	= _mm_xor_ps(s[north], sign);
+			s[southwest]= _mm_xor_ps(s[northeast], sign);
+			s[west]		= _mm_xor_ps(s[east], sign);
+			s[northwest]= _mm_xor_ps(s[southeast], sign);
+			break;
+		}
+		__m128 max = _mm_max_ps(_mm_max_ps(_mm_max_ps(s[0], s[1]), _mm_max_ps(s[2], s[3])),
+								_mm_max_ps(_mm_max_ps(s[4], s[5]), _mm_max_ps(s[6], s[7])));
+		__m128i dirs = _mm_setzero_si128();
+		for(int dir=north; dir<none; dir++)
+		{
+			__m128i hit = _mm_castps_si128(_mm_cmpge_ps(s[dir], max));
+			dirs = _mm_or_si128(dirs, _mm_and_si128(hit, _mm_set1_epi32(dirBit(dir))));
+		}
+		__m128i words = _mm_packs_epi32(dirs, dirs);
+		int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		memcpy(out+i, &bytes, 4);
+	}
+	return i;
+}
+
+#endif
+
+template<FlowMethod method>
+static void flowDirsRowFor(const float *up, const float *mid, const float *down,
+							unsigned char *out, int count)
+{
+	int done = 0;
+#ifdef FLOWDIR_X86
+	static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+	static const bool hasSSE2 = __builtin_cpu_supports("sse2");
+	if(hasAVX2)
+		done = flowDirsAVX2<method>(up, mid, down, out, count);
+	else if(hasSSE2)
+		done = flowDirsSSE2<method>(up, mid, down, out, count);
+#endif
+	for(int i = done; i < count; i++)
+		out[i] = flowDirsCell<method>(up+i, mid+i, down+i);
+}
+
+//every cell flows south
+static void flowDirsDummy(const float*, const float*, const float*,
+							unsigned char *out, int count)
+{
+	memset(out, dirBit(south), count);
+}
+
+FlowDirsKernel flowDirsKernel(FlowMethod method)
+{
+	switch(method)
+	{
+		case direct:	return flowDirsRowFor<direct>;
+		case dummy:		return flowDirsDummy;
+		case lowest:	return flowDirsRowFor<lowest>;
+		case cross:
+		default:		return flowDirsRowFor<cross>;
+	}
+}
+
+void flowDirsRow(const float *up, const float *mid, const float *down,
+					unsigned char *out, int count, FlowMethod method)
+{
+	flowDirsKernel(method)(up, mid, down, out, count);
+}
@@ -0,0 +1,40 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLOWDIR_H
+#define FLOWDIR_H
+
+#include "cell.h"
+
+/*	Work out the possible flow directions of a run of count cells in the
+	interior of the DEM, all at once. up, mid and down point at the first cell
+	of the run in the row above, the row itself and the row below. Each cell
+	gets a bitmask of the directions it may flow (see dirBit()) in out.
+	Uses AVX2 or SSE2 when the processor has them.
+
+	The kernel for a method. There's one compiled for each, with nothing
+	left to decide per cell, so choose it once and use it for every row.
+*/
+FlowDirsKernel flowDirsKernel(FlowMethod method);
+
+//the same, choosing the kernel each time
+void flowDirsRow(const float *up, const float *mid, const float *down,
+					unsigned char *out, int count, FlowMethod method);
+
+#endif
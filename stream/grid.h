@@ -0,0 +1,104 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <cstddef>
+
+#include "scratch.h"
+
+/*	A rectangle of cells in memory: height rows of width cells, each row
+	starting stride cells after the one before. A view doesn't own its cells,
+	and is cheap to copy. Every view knows its own size, so grids of any sizes
+	can be used side by side from any thread.
+*/
+template<typename T>
+class GridView
+{
+	public:
+	GridView() : cells(NULL), cellsY(0), cellsX(0), step(0) {}
+	GridView(T *cells, int height, int width, long stride = -1)
+		: cells(cells), cellsY(height), cellsX(width), step(stride < 0 ? width : stride) {}
+
+	int height() const {return cellsY;}
+	int width() const {return cellsX;}
+	long stride() const {return step;}
+	long size() const {return (long)cellsY * cellsX;}
+	//whether the rows follow on from each other, so the cells can be walked as one array
+	bool contiguous() const {return step == cellsX;}
+
+	T* data() const {return cells;}
+	T* row(int y) const {return cells + y*step;}
+	long index(int y, int x) const {return y*step + x;}
+	bool contains(int y, int x) const {return y >= 0 && x >= 0 && y < cellsY && x < cellsX;}
+	T& operator()(int y, int x) const {return cells[index(y,x)];}
+	//by index(), not by position in the rectangle
+	T& operator[](long cell) const {return cells[cell];}
+
+	//a part of this grid, which shares its cells
+	GridView window(int y, int x, int height, int width) const
+	{
+		return GridView(cells + index(y,x), height, width, step);
+	}
+
+	/*	The cells around the outside, as one sequence: the top row, then the
+		left and right ends of each row in between, then the bottom row.
+	*/
+	long borderSize() const
+	{
+		if(cellsY < 2 || cellsX < 2) return size();
+		return 2L*cellsX + 2L*cellsY - 4;
+	}
+	//index() of the given cell of the border
+	long borderIndex(long i) const
+	{
+		if(cellsY < 2 || cellsX < 2) return index(i / cellsX, i % cellsX);
+		if(i < cellsX) return i;
+		i -= cellsX;
+		if(i < 2L*(cellsY-2)) return index(i/2 + 1, (i%2) ? cellsX-1 : 0);
+		return index(cellsY-1, i - 2L*(cellsY-2));
+	}
+	T& border(long i) const {return cells[borderIndex(i)];}
+
+	protected:
+	T *cells;
+	int cellsY, cellsX;
+	long step;
+};
+
+/*	A grid that owns its cells. They come from Scratch, so they are on disk in
+	out-of-core mode, and start on a cache line. The rows aren't padded, so the
+	cells of a Grid can be handed to anything that wants one flat array.
+*/
+template<typename T>
+class Grid : public GridView<T>
+{
+	public:
+	Grid(int height, int width)
+		: GridView<T>(Scratch::allocate<T>((long)height * width), height, width) {}
+	~Grid() {Scratch::release(this->cells);}
+
+	private:
+	//one owner only; copy a view of it instead
+	Grid(const Grid&);
+	Grid& operator=(const Grid&);
+};
+
+#endif
@@ -0,0 +1,279 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GRIDFILE_H
+#define GRIDFILE_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/*	A grid file holds the grids stream makes (the SDEM, flow directions and flow
+	totals) in one binary file that zone and the plotter can memory-map and use
+	as-is, without parsing any text. It is laid out like this, with every number
+	little-endian:
+		GridFileHeader
+		the projection, as projectionLength bytes of WKT
+		a GridFileLayer for each layer
+		the layers, each a row-major array of width*height cells starting at
+		its offset, which is a multiple of GRID_ALIGN
+	This header is shared by stream, zone and the plotter.
+*/
+
+const char GRID_MAGIC[8] = {'L','A','H','A','R','G','R','D'};
+const boost::uint32_t GRID_VERSION = 1;
+const boost::uint64_t GRID_ALIGN = 64;
+
+//the kind of number in each cell of a layer
+enum GridType
+{
+	gridFloat32 = 1,
+	gridUInt8 = 2,
+	gridUInt64 = 3
+};
+
+struct GridFileHeader
+{
+	char magic[8];
+	boost::uint32_t version;
+	boost::uint32_t layerCount;
+	boost::uint32_t width, height;
+	double geoTransform[6];			//as GDAL gives it
+	boost::uint32_t projectionLength;
+	boost::uint32_t reserved;
+};
+
+struct GridFileLayer
+{
+	char name[16];					//NUL-padded, e.g. "sdem"
+	boost::uint32_t type;			//a GridType
+	boost::uint32_t reserved;
+	boost::uint64_t offset;			//from the start of the file
+};
+
+inline bool gridHostIsLittleEndian()
+{
+	const boost::uint16_t one = 1;
+	return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+inline size_t gridTypeSize(boost::uint32_t type)
+{
+	switch(type)
+	{
+		case gridFloat32:	return 4;
+		case gridUInt8:		return 1;
+		case gridUInt64:	return 8;
+	}
+	return 0;
+}
+
+/*	Maps a grid file into memory. The layers point straight into the mapping,
+	so they are only good while the GridFile is. Throws std::runtime_error if
+	the file can't be mapped or isn't a grid file.
+*/
+class GridFile
+{
+	public:
+	GridFile(const std::string& path)
+	{
+		if(!gridHostIsLittleEndian())
+			throw std::runtime_error("grid files can only be mapped on little-endian machines");
+		try{
+			file = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+			region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+		}catch(boost::interprocess::interprocess_exception& e){
+			throw std::runtime_error(path + ": " + e.what());
+		}
+		base = static_cast<const char*>(region.get_address());
+		size = region.get_size();
+
+		header = reinterpret_cast<const GridFileHeader*>(base);
+		if(size < sizeof(GridFileHeader) || memcmp(header->magic, GRID_MAGIC, 8) != 0)
+			throw std::runtime_error(path + ": not a grid file");
+		if(header->version != GRID_VERSION)
+			throw std::runtime_error(path + ": unsupported grid file version");
+		boost::uint64_t layersAt = sizeof(GridFileHeader) + header->projectionLength;
+		if(layersAt + (boost::uint64_t)header->layerCount * sizeof(GridFileLayer) > size)
+			throw std::runtime_error(path + ": grid file is truncated");
+		layers = reinterpret_cast<const GridFileLayer*>(base + layersAt);
+
+		boost::uint64_t cells = (boost::uint64_t)header->width * header->height;
+		for(boost::uint32_t i = 0; i < header->layerCount; i++)
+		{
+			size_t typeSize = gridTypeSize(layers[i].type);
+			if(typeSize == 0 || layers[i].offset % GRID_ALIGN != 0
+				|| layers[i].offset + cells * typeSize > size)
+				throw std::runtime_error(path + ": grid file has a bad layer");
+		}
+	}
+
+	int width() const {return header->width;}
+	int height() const {return header->height;}
+	const double* geoTransform() const {return header->geoTransform;}
+	std::string projection() const
+	{
+		return std::string(base + sizeof(GridFileHeader), header->projectionLength);
+	}
+
+	//The cells of the named layer, or NULL if there's no such layer of that type.
+	template<typename T>
+	const T* layer(const std::string& name, GridType type) const
+	{
+		for(boost::uint32_t i = 0; i < header->layerCount; i++)
+		{
+			if(strncmp(layers[i].name, name.c_str(), sizeof(layers[i].name)) == 0)
+			{
+				if(layers[i].type != (boost::uint32_t)type || gridTypeSize(type) != sizeof(T))
+					return NULL;
+				return reinterpret_cast<const T*>(base + layers[i].offset);
+			}
+		}
+		return NULL;
+	}
+
+	private:
+	boost::interprocess::file_mapping file;
+	boost::interprocess::mapped_region region;
+	const char *base;
+	size_t size;
+	const GridFileHeader *header;
+	const GridFileLayer *layers;
+};
+
+/*	Writes a grid file. Add all the layers, create() the file, and then write()
+	each layer once its grid is done. Different layers can be written from
+	different threads at the same time.
+*/
+class GridFileWriter
+{
+	public:
+	GridFileWriter(const std::string& path, int width, int height,
+					const double geoTransform[6], const std::string& projection)
+		: path(path), projection(projection)
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, GRID_MAGIC, 8);
+		header.version = GRID_VERSION;
+		header.width = width;
+		header.height = height;
+		memcpy(header.geoTransform, geoTransform, sizeof(header.geoTransform));
+		header.projectionLength = projection.size();
+	}
+
+	//Returns the number to write() the layer with.
+	int addLayer(const char *name, GridType type)
+	{
+		GridFileLayer layer;
+		memset(&layer, 0, sizeof(layer));
+		strncpy(layer.name, name, sizeof(layer.name) - 1);
+		layer.type = type;
+		layers.push_back(layer);
+		return layers.size() - 1;
+	}
+
+	//Writes the header and makes the file full size. Returns false if it can't.
+	bool create()
+	{
+		header.layerCount = layers.size();
+		boost::uint64_t offset = sizeof(GridFileHeader) + projection.size()
+									+ layers.size() * sizeof(GridFileLayer);
+		for(size_t i = 0; i < layers.size(); i++)
+		{
+			offset = (offset + GRID_ALIGN - 1) / GRID_ALIGN * GRID_ALIGN;
+			layers[i].offset = offset;
+			offset += cells() * gridTypeSize(layers[i].type);
+		}
+
+		std::ofstream out(path.c_str(), std::ios_base::binary | std::ios_base::trunc);
+		GridFileHeader leHeader = header;
+		toLittleEndian(&leHeader.version, 4, 4);
+		toLittleEndian(leHeader.geoTransform, 8, 6);
+		toLittleEndian(&leHeader.projectionLength, 4, 2);
+		out.write(reinterpret_cast<const char*>(&leHeader), sizeof(leHeader));
+		out.write(projection.data(), projection.size());
+		for(size_t i = 0; i < layers.size(); i++)
+		{
+			GridFileLayer leLayer = layers[i];
+			toLittleEndian(&leLayer.type, 4, 2);
+			toLittleEndian(&leLayer.offset, 8, 1);
+			out.write(reinterpret_cast<const char*>(&leLayer), sizeof(leLayer));
+		}
+		//the layers get written later, so just make room for them
+		if(offset > 0)
+		{
+			out.seekp(offset - 1);
+			out.put(0);
+		}
+		return out.good();
+	}
+
+	//Writes out all the cells of a layer in one go.
+	bool write(int layer, const void *cells)
+	{
+		std::fstream out(path.c_str(), std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		out.seekp(layers[layer].offset);
+		size_t typeSize = gridTypeSize(layers[layer].type);
+		const char *bytes = static_cast<const char*>(cells);
+		if(gridHostIsLittleEndian() || typeSize == 1)
+		{
+			out.write(bytes, this->cells() * typeSize);
+		}else{
+			//swap a big piece at a time
+			const size_t CHUNK = 1 << 22;
+			std::vector<char> buffer(CHUNK);
+			boost::uint64_t total = this->cells() * typeSize;
+			for(boost::uint64_t done = 0; done < total; done += CHUNK)
+			{
+				size_t count = (size_t)std::min<boost::uint64_t>(CHUNK, total - done);
+				memcpy(&buffer[0], bytes + done, count);
+				toLittleEndian(&buffer[0], typeSize, count / typeSize);
+				out.write(&buffer[0], count);
+			}
+		}
+		return out.good();
+	}
+
+	private:
+	std::string path, projection;
+	GridFileHeader header;
+	std::vector<GridFileLayer> layers;
+
+	boost::uint64_t cells() const
+	{
+		return (boost::uint64_t)header.width * header.height;
+	}
+
+	static void toLittleEndian(void *values, size_t size, size_t count)
+	{
+		if(gridHostIsLittleEndian()) return;
+		char *bytes = static_cast<char*>(values);
+		for(size_t i = 0; i < count; i++, bytes += size)
+			std::reverse(bytes, bytes + size);
+	}
+};
+
+#endif
@@ -18,9 +18,7 @@
 */
 
 #include "main.h"
-
-Cell *dem = NULL;
-Logger lg;
+#include "batch.h"
 
 int main(int argc, char* argv[])
 {
@@ -31,13 +29,35 @@ int main(int argc, char* argv[])
 		("input-file,f", po::value<string>(), "Read topography from input file <arg>")
 		("std-in,i", "Read topography from standard-in. Can't be used with --input-file.")
 		("output-file,o", po::value<string>(), "Output to files using the base name <arg>.")
+		("tsv",
+			"With --output-file, also write the grids as tab-separated text in <arg>-sdem.tsv, <arg>-fdir.tsv and <arg>-ftotal.tsv.")
+		("compress", po::value<string>(),
+			"Compress the --tsv files as they are written.\ngz = gzip, to *.tsv.gz\nzst = Zstandard, to *.tsv.zst")
 		("std-out,t",
 			"Output to standard-out. May be used with --output-file. Silences all logging.")
+		("batch", po::value<string>(),
+			"Process every DEM listed in file <arg>, one per line as the input file, then a tab and the base name to output to. Without one, the outputs are named after the input. Small DEMs are done side by side on a thread each, big ones one at a time on all the threads. A summary of each is written to standard-out. Can't be used with the other input or output options, but --tsv and --compress apply to every DEM.")
 		("threads,r", po::value<int>(),
 			"Set number of threads for parallel calculations. Default is 4.")
 		("loglevel,l", po::value<string>(),
 			"Control the amount of status information.\nsilent = No status info.\nnormal = Prints error messages and major action statements.\nprogress = Prints a character for each row processed.\ndebug = Prints verbose status information.")
 		("eof,e", "Sends an EOF to standard-out when done, even in silent mode.")
+		("out-of-core", po::value<string>(),
+			"Keep the grids in memory-mapped scratch files in directory <arg>, for DEMs bigger than memory. Fills sinkholes with 'tiled' unless --fill says otherwise.")
+		("fill", po::value<string>(),
+			"Choose how sinkholes are filled.\nplanchon = Planchon-Darboux (default).\npriority-flood = Priority-Flood. Much faster, and finds the flow directions along the way.\ntiled = Priority-Flood on strips of the DEM in parallel, using every thread.")
+		("flow-method", po::value<string>(),
+			"Choose how the possible flow directions of a cell are found. Not used by --fill priority-flood, which finds its own.\nlowest = Toward the lowest neighbors (default).\ndirect = Toward the neighbors with the biggest drop.\ncross = Across the steepest of the slopes between opposite neighbors.")
+		("update", po::value<string>(),
+			"Bring the outputs of an earlier run, with the base name <arg>, up to date for a DEM that has changed only in the --window since, doing again only the work that the change reaches. The new outputs must go to other files. Can't be used with --batch or --fill priority-flood.")
+		("window", po::value<string>(),
+			"The part of the DEM that changed, for --update, as <column>,<row>,<width>,<height> in cells from the top-left corner.")
+		("progress-fd", po::value<int>(),
+			"Report progress on file descriptor <arg> as lines of JSON, at most every 100 ms.")
+		("timings", po::value<string>(),
+			"Write the wall and CPU time, cells per second, peak memory and threads of each phase to file <arg>, as JSON. Can't be used with --batch.")
+		("alloc-profile", po::value<string>(),
+			"Count the memory each phase allocates, log the most it had in use at once, and write that and the 20 call sites that allocated the most to file <arg>. Only in builds with -DALLOC_PROFILE. Can't be used with --batch.")
 	;
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -52,18 +72,17 @@ int main(int argc, char* argv[])
 	
 	//check for various contradictory option settings, or missing required options.
 	string optError = "";
-	string infile = "", outfile = "";
-	cmdIn = vm.count("std-in");
-	cmdOut = vm.count("std-out");
-	sendEOF = vm.count("eof");
-	int threads = vm.count("threads") ? abs(vm["threads"].as<int>()) : 4;
-	sDem = new fs::ofstream;
-	meta = new fs::ofstream;
-	flowDir = new fs::ofstream;
-	flowTotal = new fs::ofstream;
+	string infile = "", outfile = "", batchfile = "";
+	bool cmdIn = vm.count("std-in");
+	bool sendEOF = vm.count("eof");
+	bool batch = vm.count("batch");
+	OutputOptions output;
+	output.cmdOut = vm.count("std-out");
+	TerrainOptions options;
+	if(vm.count("threads")) options.threads = abs(vm["threads"].as<int>());
 
 	//if Loglevel is specified and cout isn't being used for data output
-	if(vm.count("loglevel") && !cmdOut)
+	if(vm.count("loglevel") && !output.cmdOut)
 	{
 		try{lg.init(Logger::string2level(vm["loglevel"].as<string>()));}
 		catch(...)
@@ -71,7 +90,7 @@ int main(int argc, char* argv[])
 			cout<<"Bad Loglevel. Try 'stream --help' for more information.\n";
 			return 1;
 		}
-	}else if(cmdOut){
+	}else if(output.cmdOut){
 		//if cout is being used for data output
 		lg.init(silent);
 	}else{
@@ -79,8 +98,16 @@ int main(int argc, char* argv[])
 		lg.init(normal);
 	}
 	
-	if(vm.count("input-file"))
+	if(batch)
 	{
+		batchfile = vm["batch"].as<string>();
+		if(!fs::exists(batchfile))
+			optError = batchfile + ": No such file or directory\n";
+		if(vm.count("input-file") || cmdIn || vm.count("output-file") || output.cmdOut)
+			optError = "--batch names the input and output files itself\n";
+		if(vm.count("progress-fd"))
+			optError = "can't report progress on more than one DEM at once\n";
+	}else if(vm.count("input-file")){
 		infile = vm["input-file"].as<string>();
 		if(!fs::exists(infile))
 		{
@@ -95,48 +122,207 @@ int main(int argc, char* argv[])
 			optError = "no input source specified\nTry 'stream --help' for more information.\n";
 	}
 	
+	if(vm.count("out-of-core"))
+	{
+		string scratchDir = vm["out-of-core"].as<string>();
+		if(!fs::is_directory(scratchDir))
+			optError = scratchDir + ": Not a directory\n";
+		else
+			Scratch::useDirectory(scratchDir);
+		//the strips of the tiled fill go through the pages in order
+		if(!vm.count("fill")) options.fill = fillTiled;
+	}
+
+	if(vm.count("fill"))
+	{
+		string fillMethod = vm["fill"].as<string>();
+		if(fillMethod == "priority-flood")
+			options.fill = fillPriorityFlood;
+		else if(fillMethod == "tiled")
+			options.fill = fillTiled;
+		else if(fillMethod != "planchon")
+			optError = "unknown fill method: " + fillMethod + "\n";
+	}
+
+	if(vm.count("flow-method"))
+	{
+		string flowMethod = vm["flow-method"].as<string>();
+		if(flowMethod == "cross")
+			options.flow = cross;
+		else if(flowMethod == "direct")
+			options.flow = direct;
+		else if(flowMethod != "lowest")
+			optError = "unknown flow method: " + flowMethod + "\n";
+	}
+
+	output.tsvOut = vm.count("tsv");
+	if(vm.count("compress"))
+	{
+		string method = vm["compress"].as<string>();
+		if(method == "gz")
+			output.compression = gzipped;
+		else if(method == "zst")
+			output.compression = zstandard;
+		else
+			optError = "unknown compression: " + method + "\n";
+	}
+
 	if(vm.count("output-file"))
 	{
-		fileOut = true;
 		outfile = vm["output-file"].as<string>();
 		if(outfile.empty())
-		{
 			optError = "invalid filename\n";
-		}else{
-			sDem->open(outfile+"-sdem.tsv");
-			meta->open(outfile+".ini");
-			flowDir->open(outfile+"-fdir.tsv");
-			flowTotal->open(outfile+"-ftotal.tsv");
-			if(!(*sDem && *meta && *flowDir && *flowTotal))
-				optError = string("couldn't open output files\n(Is the filename valid?)")
-							+"\n(Is there a permissions issue?)\n";
-		}
 	}else{
-		if(!cmdOut)
+		if(!output.cmdOut && !batch)
 			optError = "no output method specified\nTry 'stream --help' for more information.\n";
 	}
 
+	UpdateOptions update;
+	if(vm.count("update"))
+	{
+		update.previous = vm["update"].as<string>();
+		if(!fs::exists(update.previous + ".grids"))
+			optError = update.previous + ".grids: No such file or directory\n";
+		if(!vm.count("window"))
+			optError = "--update needs the --window that changed\n";
+		if(batch)
+			optError = "--batch can't update earlier runs\n";
+		if(options.fill == fillPriorityFlood)
+			optError = "the results of --fill priority-flood can't be updated\n";
+	}
+	if(vm.count("window"))
+	{
+		string window = vm["window"].as<string>();
+		char rest;
+		if(sscanf(window.c_str(), "%d,%d,%d,%d%c", &update.x, &update.y,
+					&update.width, &update.height, &rest) != 4
+			|| update.x < 0 || update.y < 0 || update.width < 1 || update.height < 1)
+			optError = "invalid window: " + window + "\n";
+		if(!vm.count("update"))
+			optError = "--window is only for --update\n";
+	}
+
+	if(vm.count("progress-fd") && vm["progress-fd"].as<int>() < 0)
+		optError = "invalid progress file descriptor\n";
+
+	string timingsFile = "";
+	boost::scoped_ptr<Timings> timings;
+	if(vm.count("timings"))
+	{
+		timingsFile = vm["timings"].as<string>();
+		if(timingsFile.empty())
+			optError = "invalid timings filename\n";
+		if(batch)
+			optError = "can't time more than one DEM at once\n";
+		timings.reset(new Timings("stream"));
+		output.timings = timings.get();
+	}
+
+	string allocFile = "";
+	if(vm.count("alloc-profile"))
+	{
+		allocFile = vm["alloc-profile"].as<string>();
+		if(allocFile.empty())
+			optError = "invalid allocation profile filename\n";
+		if(batch)
+			optError = "can't profile more than one DEM at once\n";
+		if(!AllocProfile::available())
+			optError = "this stream wasn't built with -DALLOC_PROFILE\n";
+	}
+
+	vector<BatchJob> jobs;
+	if(optError == "" && batch && !Batch::readList(batchfile, jobs))
+		optError = batchfile + ": couldn't read the list of DEMs\n";
+
 	if(optError != "")
 	{
 		lg.set(normal) << "stream: " << optError << "\n";
 		return 1;
 	}
+	if(vm.count("progress-fd")) Progress::start(vm["progress-fd"].as<int>());
+	Progress::timeWith(timings.get());
+	if(!allocFile.empty())
+	{
+		AllocProfile::start();
+		Progress::listen(AllocProfile::phase);
+	}
 	
 	//Done setting up. Now, start reading the DEM.
-	lg.set(normal) << "Reading file...\n";
-	GDALDataset  *poDataset;
 	GDALAllRegister();
-	poDataset = (GDALDataset*)GDALOpen(infile.c_str(), GA_ReadOnly);
-	if(poDataset == NULL)
+	bool ok = true;
+	if(batch)
 	{
-		lg.set(normal) << "There was a problem opening the topography file.\n";
-		return 1;
+		Batch runner(options, output);
+		ok = runner.run(jobs);
+		//the jobs' messages all come out before it
+		lg.flush();
+		runner.writeSummary(cout);
+	}else{
+		try{
+			lg.set(normal) << "Reading file...\n";
+			GDALDataset *poDataset = (GDALDataset*)GDALOpen(infile.c_str(), GA_ReadOnly);
+			if(poDataset == NULL)
+				throw runtime_error("There was a problem opening the topography file.");
+			streamDem(poDataset, outfile, options, output, update);
+		}catch(exception& e){
+			lg.set(normal) << e.what() << '\n';
+			ok = false;
+		}
+	}
+	
+	//tell any stdout-captors that we are done
+	Progress::stop();
+	if(timings.get() && !timings->write(timingsFile))
+	{
+		lg.set(normal) << "stream: couldn't write the timings to " << timingsFile << '\n';
+		ok = false;
+	}
+	if(!allocFile.empty() && !AllocProfile::write(allocFile, 20))
+	{
+		lg.set(normal) << "stream: couldn't write the allocation profile to " << allocFile << '\n';
+		ok = false;
+	}
+	lg.flush();
+	if(sendEOF) cout << EOF;
+	return ok ? 0 : 1;
+}
+
+void streamDem(GDALDataset *poDataset, const string& outfile,
+				const TerrainOptions& options, const OutputOptions& output,
+				const UpdateOptions& update)
+{
+	//closed as soon as it has been read, or on the way out if something goes wrong
+	DatasetCloser dataset(poDataset);
+	const bool fileOut = !outfile.empty();
+	const bool tsvOut = fileOut && output.tsvOut;
+	const int threads = options.threads;
+	//the TSV writers after the streams are found share the threads between them
+	const int tsvWriters = (tsvOut ? 2 : 0) + (output.cmdOut ? 1 : 0);
+	const int tsvThreads = max(1, threads / max(tsvWriters, 1));
+
+	fs::ofstream meta;
+	boost::scoped_ptr<TsvFile> sDem, flowDir, flowTotal;
+	if(fileOut)
+	{
+		string ending = string(".tsv") + TsvFile::ending(output.compression);
+		meta.open(outfile+".ini");
+		if(tsvOut)
+		{
+			sDem.reset(new TsvFile(outfile+"-sdem"+ending, output.compression));
+			flowDir.reset(new TsvFile(outfile+"-fdir"+ending, output.compression));
+			flowTotal.reset(new TsvFile(outfile+"-ftotal"+ending, output.compression));
+		}
+		if(!(meta && (!tsvOut || (sDem->is_open() && flowDir->is_open() && flowTotal->is_open()))))
+			throw runtime_error(string("couldn't open output files\n(Is the filename valid?)")
+						+"\n(Is there a permissions issue?)");
 	}
 
 	Metadata iniData;
 	double	adfGeoTransform[6];
-	Cell::cellsX = poDataset->GetRasterXSize(),
-	Cell::cellsY = poDataset->GetRasterYSize();
+	int cellsX = poDataset->GetRasterXSize(),
+		cellsY = poDataset->GetRasterYSize();
+	iniData.cellsX = cellsX;
+	iniData.cellsY = cellsY;
 	//int layers = poDataset->GetRasterCount();
 			
     if(poDataset->GetProjectionRef() != NULL)
@@ -144,262 +330,247 @@ int main(int argc, char* argv[])
 		iniData.projection = poDataset->GetProjectionRef();
 	}
 
-    if(poDataset->GetGeoTransform( adfGeoTransform ) == CE_None)
+    if(poDataset->GetGeoTransform( adfGeoTransform ) != CE_None)
     {
+		//GDAL's default: one unit per pixel, from the top-left corner
+		double identity[6] = {0, 1, 0, 0, 0, 1};
+		copy(identity, identity+6, adfGeoTransform);
+	}else{
 		iniData.originX = adfGeoTransform[0];
 		iniData.originY = adfGeoTransform[3];
 		iniData.physicalSize = adfGeoTransform[1];
 		//above size is X-size. Y-size is in adfGeoTransform[5]
 	}
-
-	boost::thread_group writeout;	
-	if(fileOut)	writeout.add_thread(new boost::thread(writeMeta, iniData));
-	
-	//set up globals for interthread data sharing
-	dem = new Cell[Cell::cellsX * Cell::cellsY];
-	pafScanline = new float[Cell::cellsX * Cell::cellsY];
+	copy(adfGeoTransform, adfGeoTransform+6, iniData.geoTransform);
 
 	GDALRasterBand  *poBand;
-	int             nBlockXSize, nBlockYSize;
-	int             bGotMin, bGotMax;
 	int				inXSize, inYSize;
-	double          adfMinMax[2];
-	string			demDT;
 	poBand = poDataset->GetRasterBand(1);
-	poBand->GetBlockSize( &nBlockXSize, &nBlockYSize );
-	demDT = poBand->GetRasterDataType();
-	adfMinMax[0] = poBand->GetMinimum( &bGotMin );
-	adfMinMax[1] = poBand->GetMaximum( &bGotMax );
-	if(!(bGotMin && bGotMax))
-		GDALComputeRasterMinMax((GDALRasterBandH)poBand, TRUE, adfMinMax);
 	inXSize = abs(poBand->GetXSize());
 	inYSize = abs(poBand->GetYSize());
-	poBand->RasterIO( GF_Read, 0, 0, inXSize, inYSize, pafScanline, inXSize, inYSize, GDT_Float32, 0, 0 );
-	GDALClose((GDALDatasetH*)poDataset);
 	
-	if(Cell::cellsX < 2 || Cell::cellsY < 2 || inXSize != Cell::cellsX || inYSize != Cell::cellsY)
+	if(cellsX < 2 || cellsY < 2 || inXSize != cellsX || inYSize != cellsY)
+		throw runtime_error("Something is wrong with the input DEM. Aborting.");
+	int hasNoData = FALSE;
+	double noDataValue = poBand->GetNoDataValue(&hasNoData);
+
+	//the earlier run is read straight from its grid file, so it mustn't be written over
+	boost::scoped_ptr<GridFile> previous;
+	TerrainResults before;
+	if(!update.previous.empty())
 	{
-		lg.set(normal) << "Something is wrong with the input DEM. Aborting.\n";
-		delete[] dem;
-		delete[] pafScanline;
-		return 1;
+		string previousGrids = update.previous + ".grids";
+		if(fileOut && fs::exists(outfile + ".grids") && fs::equivalent(outfile + ".grids", previousGrids))
+			throw runtime_error("--update can't write its outputs over the ones it starts from");
+		previous.reset(new GridFile(previousGrids));
+		if(previous->width() != cellsX || previous->height() != cellsY)
+			throw runtime_error(previousGrids + " isn't the size of the DEM");
+		const float *sdem = previous->layer<float>("sdem", gridFloat32);
+		const unsigned char *fdir = previous->layer<unsigned char>("fdir", gridUInt8);
+		const unsigned long long *ftotal = previous->layer<unsigned long long>("ftotal", gridUInt64);
+		if(sdem == NULL || fdir == NULL || ftotal == NULL)
+			throw runtime_error(previousGrids + " is missing a grid");
+		before.filled = GridView<const float>(sdem, cellsY, cellsX);
+		before.flowDirections = GridView<const unsigned char>(fdir, cellsY, cellsX);
+		before.flowTotals = GridView<const unsigned long long>(ftotal, cellsY, cellsX);
 	}
 	
-	linear(pafScanline,0,0,Cell::cellsX);	//initialize static variable inside linear()
-	linear(dem,0,0,Cell::cellsX);
-		
-	//Fill in the sinkholes!
-	lg.set(normal) << "Filling sinkholes...\n";
-	FillSinks filler(pafScanline, Cell::cellsY, Cell::cellsX, 0.00/*1*/);
-	filler.fill();
+	//the grids all go in one binary file, written a layer at a time as they're finished
+	boost::scoped_ptr<GridFileWriter> grids;
+	int sdemLayer = 0, flowDirLayer = 0, flowTotalLayer = 0;
+	if(fileOut)
+	{
+		grids.reset(new GridFileWriter(outfile+".grids", cellsX, cellsY,
+										iniData.geoTransform, iniData.projection));
+		sdemLayer = grids->addLayer("sdem", gridFloat32);
+		flowDirLayer = grids->addLayer("fdir", gridUInt8);
+		flowTotalLayer = grids->addLayer("ftotal", gridUInt64);
+		if(!grids->create())
+			throw runtime_error("stream: couldn't create " + outfile + ".grids");
+	}
 	
-	//We have the data from the file, now we make the data 2-dimensional for easier reading.
-	//The cells on the outside are made with default outward flow directions.
-	if(threads > Cell::cellsY) threads = Cell::cellsY;
-	int rowsPerThread = Cell::cellsY / threads;
-	lg.set(progress) << "XSize=" << Cell::cellsX << ",YSize=" << Cell::cellsY
-		<< ",Cells=" << (Cell::cellsX*Cell::cellsY) << '\n';
-	lg.set(normal)	<< "Building DEM...\n";
-	boost::thread_group demFiller;
+	//The heights from the file go straight into the elevation grid.
+	boost::scoped_ptr<Terrain> terrain;
+	try{
+		terrain.reset(new Terrain(cellsY, cellsX, options));
+	}catch(exception& e){
+		throw runtime_error(string("Couldn't make room for the DEM: ") + e.what());
+	}
+	if(hasNoData) terrain->setNoDataValue((float)noDataValue);
+	const long long cells = (long long)cellsX * cellsY;
+	RasterReader reader(poBand, terrain->elevation());
+	Progress::phase("read", cells);
+	reader.start();
+	LOG(progress, "XSize=" << cellsX << ",YSize=" << cellsY
+		<< ",Cells=" << ((long)cellsX*cellsY) << '\n');
 	
-	for(int thread=0; thread<(threads-1); thread++)
+	//work on the rows can start as they come in
+	for(int row = 0; row < cellsY; )
 	{
-		int firstRow = thread*rowsPerThread;
-		demFiller.add_thread(new boost::thread(linearTo2d, firstRow,
-												firstRow+rowsPerThread));
+		int rows = reader.waitForRows(row+1);
+		if(rows <= row) break;
+		terrain->rowsReady(rows);
+		row = rows;
 	}
-	demFiller.add_thread(new boost::thread(linearTo2d, (threads-1)*rowsPerThread,
-											Cell::cellsY));
 	
-	demFiller.join_all();	//wait until all the data is in place before doing calcs on it
-	delete[] pafScanline;
+	bool readOK = reader.join();
+	dataset.close();
+	if(!readOK)
+		throw runtime_error("There was a problem reading the topography file.");
 	//Done reading DEM...
-	if(fileOut)	writeout.add_thread(new boost::thread(writeSdem));
 	
-	edge(dem,0,Cell::cellsX,Cell::cellsY);	//initialize width and height in function
-
-	//Now do calculations.
-	lg.set(normal) << "\nCalculating...\n";
-
-	//make flow total grid
-	lg.set(normal) << "\nFinding streams...\n";
-	boost::thread_group flowTotalCalc;
-	const unsigned long edgeCells = (2*Cell::cellsX + 2*Cell::cellsY - 4);
-	const unsigned long cellsPerThread = edgeCells / threads;
-	for(int thread=0; thread<(threads-1); thread++)
+	boost::thread_group writeout;	
+	if(fileOut)	startWriter(writeout, output.timings, "write ini", 0, 1, boost::bind(writeMeta, &meta, iniData));
+	
+	//the simplified DEM is written out while the streams are found
+	if(previous.get())
 	{
-		unsigned long firstCell = thread * cellsPerThread;
-		flowTotalCalc.add_thread(new boost::thread(flowTrace, firstCell, firstCell+cellsPerThread));
-		lg.write(debug, "Assigned thread.\n");
+		try{
+			terrain->update(before, update.y, update.x, update.height, update.width);
+		}catch(invalid_argument& e){
+			throw runtime_error(string("Can't update ") + update.previous + ": " + e.what());
+		}
+		previous.reset();
+	}else{
+		terrain->fill();
 	}
-	flowTotalCalc.add_thread(new boost::thread(flowTrace, (threads-1)*cellsPerThread, edgeCells));
-	flowTotalCalc.join_all();
-	lg.write(progress, '\n');
+	GridView<float> sdem = terrain->filled();
+	if(fileOut)	startWriter(writeout, output.timings, "write grids sdem", cells, 1,
+							boost::bind(writeGridLayer, grids.get(), sdemLayer, sdem.data()));
+	//with one formatter, as the threads are finding the streams
+	if(tsvOut)	startWriter(writeout, output.timings, "write sdem tsv", cells, 1,
+							boost::bind(writeTsv, sDem.get(), cellsY, cellsX, 1,
+										RowFormatter(boost::bind(sdemRow, sdem, _1, _2))));
+	if(update.previous.empty()) terrain->findStreams();
 
-	lg.set(normal) << "Writing output...\n";
+	LOG(normal, "Writing output...\n");
+	Progress::phase("write", cells, threads);
 	
 	//write output
-	if(fileOut)	writeout.add_thread(new boost::thread(writeFlowDir));
-	if(fileOut)	writeout.add_thread(new boost::thread(writeFlowTotal));
-	if(cmdOut)	writeout.add_thread(new boost::thread(writeStdOut, iniData));
+	GridView<unsigned char> fdir = terrain->flowDirections();
+	GridView<unsigned long long> ftotal = terrain->flowTotals();
+	if(fileOut)	startWriter(writeout, output.timings, "write grids fdir", cells, 1,
+							boost::bind(writeGridLayer, grids.get(), flowDirLayer, fdir.data()));
+	if(fileOut)	startWriter(writeout, output.timings, "write grids ftotal", cells, 1,
+							boost::bind(writeGridLayer, grids.get(), flowTotalLayer, ftotal.data()));
+	if(tsvOut)	startWriter(writeout, output.timings, "write fdir tsv", cells, tsvThreads,
+							boost::bind(writeTsv, flowDir.get(), cellsY, cellsX, tsvThreads,
+										RowFormatter(boost::bind(flowDirRow, fdir, _1, _2))));
+	if(tsvOut)	startWriter(writeout, output.timings, "write ftotal tsv", cells, tsvThreads,
+							boost::bind(writeTsv, flowTotal.get(), cellsY, cellsX, tsvThreads,
+										RowFormatter(boost::bind(flowTotalRow, ftotal, _1, _2))));
+	if(output.cmdOut)	startWriter(writeout, output.timings, "write stdout", 3*cells, tsvThreads,
+									boost::bind(writeStdOut, iniData, terrain.get(), tsvThreads));
 	writeout.join_all();
-	
-	//Free heap memory
-	delete sDem;
-	delete meta;
-	delete flowDir;
-	delete flowTotal;
-	delete[] dem;
-	
-	//tell any stdout-captors that we are done
-	if(sendEOF) cout << EOF;
-	return 0;
+	Progress::advance(cells);
 }
 
-void linearTo2d(int firstRow, int end)
+void startWriter(boost::thread_group& writers, Timings *timings, const string& name,
+				long long cells, int threads, const boost::function<void ()>& write)
 {
-	int yp = firstRow;
-	if(firstRow == 0)
-	{
-		linear(dem,yp,0).fill(linear(pafScanline, yp, 0), yp, 0, northwest);
-		for(int xp = 1; xp<(Cell::cellsX-1); xp++)
-		{
-			linear(dem,yp,xp).fill(linear(pafScanline, yp, xp), yp, xp, north);
-		}
-		linear(dem,yp,Cell::cellsX-1).fill(linear(pafScanline, yp, Cell::cellsX-1), yp, Cell::cellsX-1, northeast);
-		yp++;
-	}
-	int lastNormRow = (end==Cell::cellsY) ? end-1 : end;
-	for(; yp<lastNormRow; yp++)
-	{
-		lg.write(progress, '-');
-		linear(dem,yp,0).fill(linear(pafScanline, yp, 0), yp, 0, west);
-		for(int xp = 1; xp<(Cell::cellsX-1); xp++)
-		{
-			linear(dem,yp,xp).fill(linear(pafScanline, yp, xp), yp, xp);
-		}
-		linear(dem,yp,Cell::cellsX-1).fill(linear(pafScanline, yp, Cell::cellsX-1), yp, Cell::cellsX-1, east);
-	}
-	if(lastNormRow != end)
-	{
-		linear(dem,yp,0).fill(linear(pafScanline, yp, 0), yp, 0, southwest);
-		for(int xp = 1; xp<(Cell::cellsX-1); xp++)
-		{
-			linear(dem,yp,xp).fill(linear(pafScanline, yp, xp), yp, xp, south);
-		}
-		linear(dem,yp,Cell::cellsX-1).fill(linear(pafScanline, yp, Cell::cellsX-1), yp, Cell::cellsX-1, southeast);
-	}
+	writers.add_thread(new boost::thread(timeWriter, timings, name, cells, threads, write));
+}
+
+void timeWriter(Timings *timings, const string& name, long long cells, int threads,
+				boost::function<void ()> write)
+{
+	int phase = -1;
+	if(timings) phase = timings->begin(name, cells, threads, threads == 1 ? Timings::thread : Timings::process);
+	write();
+	if(timings) timings->end(phase);
+}
+
+void writeGridLayer(GridFileWriter *grids, int layer, const void *cells)
+{
+	if(!grids->write(layer, cells))
+		LOG(normal, "There was a problem writing the grid file.\n");
 }
 
-void writeSdem()
+void sdemRow(GridView<float> grid, TsvWriter& tsv, int row)
 {
-	for(int row=0; row<Cell::cellsY; row++)
+	const float *cells = grid.row(row);
+	for(int column=0; column<(grid.width()-1); column++)
 	{
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			*sDem << linear(dem,row,column).height << '\t';
-		}
-		*sDem << linear(dem,row,Cell::cellsX-1).height << '\n';
+		tsv.put(cells[column]);
+		tsv.put('\t');
 	}
-	sDem->close();
+	tsv.put(cells[grid.width()-1]);
+	tsv.put('\n');
 }
 
-void writeMeta(Metadata& iniData)
+void sdemRowFixed(GridView<float> grid, TsvWriter& tsv, int row)
 {
-	*meta << fixed << setprecision(0) << "[Core]\npixel_size=" << iniData.physicalSize
-			<< "\nx_pixels=" << Cell::cellsX << "\ny_pixels=" << Cell::cellsY
-			<< "\n[Display]\norigin_x=" << iniData.originX << "\norigin_y="
-			<< iniData.originY << "\nprojection=" << iniData.projection << "\n";
-	meta->close();
+	const float *cells = grid.row(row);
+	for(int column=0; column<(grid.width()-1); column++)
+	{
+		tsv.putFixed(cells[column]);
+		tsv.put('\t');
+	}
+	tsv.putFixed(cells[grid.width()-1]);
+	tsv.put('\n');
 }
 
-void writeFlowDir()
+void flowDirRow(GridView<unsigned char> grid, TsvWriter& tsv, int row)
 {
-	for(int row=0; row<Cell::cellsY; row++)
+	const unsigned char *cells = grid.row(row);
+	for(int column=0; column<(grid.width()-1); column++)
 	{
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			*flowDir << (int)(linear(dem,row,column).getFlowDir()) << '\t';
-		}
-		*flowDir << (int)(linear(dem,row,Cell::cellsX-1).getFlowDir()) << '\n';
+		tsv.put((int)cells[column]);
+		tsv.put('\t');
 	}
-	flowDir->close();
+	tsv.put((int)cells[grid.width()-1]);
+	tsv.put('\n');
 }
 
-void writeFlowTotal()
+void flowTotalRow(GridView<unsigned long long> grid, TsvWriter& tsv, int row)
 {
-	*flowTotal << fixed << setprecision(0);
-	for(int row=0; row<Cell::cellsY; row++)
+	const unsigned long long *cells = grid.row(row);
+	int numOut = 0;
+	for(int column=0; column<(grid.width()-1); column++)
 	{
-		int numOut = 0;
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			numOut = linear(dem,row,column).flowTotal;
-			*flowTotal << numOut << '\t';
-		}
-		numOut = linear(dem,row,Cell::cellsX-1).flowTotal;
-		*flowTotal << numOut << '\n';
+		numOut = cells[column];
+		tsv.put(numOut);
+		tsv.put('\t');
 	}
-	flowTotal->close();
+	numOut = cells[grid.width()-1];
+	tsv.put(numOut);
+	tsv.put('\n');
 }
 
-void writeStdOut(Metadata& iniData)
+void writeTsv(TsvFile *file, int rows, int columns, int threads, RowFormatter formatRow)
 {
-	cout << fixed;
+	writeRows(*file, rows, columns, threads, formatRow);
+	file->close();
+}
+
+void writeMeta(fs::ofstream *meta, Metadata& iniData)
+{
+	*meta << fixed << setprecision(0) << "[Core]\npixel_size=" << iniData.physicalSize
+			<< "\nx_pixels=" << iniData.cellsX << "\ny_pixels=" << iniData.cellsY
+			<< "\n[Display]\norigin_x=" << iniData.originX << "\norigin_y="
+			<< iniData.originY << "\nprojection=" << iniData.projection << "\n";
+	meta->close();
+}
+
+void writeStdOut(Metadata& iniData, const Terrain *terrain, int threads)
+{
+	const int cellsY = iniData.cellsY, cellsX = iniData.cellsX;
 	//write Simplified DEM
-	for(int row=0; row<Cell::cellsY; row++)
-	{
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			cout << linear(dem,row,column).height << '\t';
-		}
-		cout << linear(dem,row,Cell::cellsX-1).height << '\n';
-	}
+	writeRows(cout, cellsY, cellsX, threads, boost::bind(sdemRowFixed, terrain->filled(), _1, _2));
 	cout << '\n';
 
 	//write Metadata INI
+	cout << fixed;
 	cout << "[Core]\npixel_size=" << iniData.physicalSize << "\nx_pixels="
-			<< Cell::cellsX << "\ny_pixels=" << Cell::cellsY << "\n[Display]\norigin_x="
+			<< cellsX << "\ny_pixels=" << cellsY << "\n[Display]\norigin_x="
 			<< iniData.originX << "\norigin_y=" << iniData.originY
 			<< "\nprojection=" << iniData.projection << "\n";
 	cout << '\n';
 	
 	//Write Flow Direction Grid
-	for(int row=0; row<Cell::cellsY; row++)
-	{
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			cout << (int)(linear(dem,row,column).getFlowDir()) << '\t';
-		}
-		cout << (int)(linear(dem,row,Cell::cellsX-1).getFlowDir()) << '\n';
-	}
+	writeRows(cout, cellsY, cellsX, threads, boost::bind(flowDirRow, terrain->flowDirections(), _1, _2));
 	cout << '\n';
 	//write Flow Total Grid
-	for(int row=0; row<Cell::cellsY; row++)
-	{
-		int numOut = 0;
-		for(int column=0; column<(Cell::cellsX-1); column++)
-		{
-			numOut = linear(dem,row,column).flowTotal;
-			cout << numOut << '\t';
-		}
-		numOut = linear(dem,row,Cell::cellsX-1).flowTotal;
-		cout << numOut << '\n';
-	}
-}
-
-void flowTrace(unsigned long start, unsigned long end)
-{
-	ostringstream oss;
-	oss << "Calling flowTrace from " << start << " to " << end << '\n';
-	lg.write(debug, oss.str());
-	
-	for(unsigned long cell = start; cell < end; cell++)
-	{
-		lg.write(progress, '#');
-		oss.str(""); oss << "Seed accumulation " << cell << '\n';
-		lg.write(debug, oss.str());
-		edge(dem,cell).accumulate();
-	}
+	writeRows(cout, cellsY, cellsX, threads, boost::bind(flowTotalRow, terrain->flowTotals(), _1, _2));
 }
 
@@ -20,26 +20,37 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <cstdio>
 #include <cstdlib>
 
 #include <algorithm>
 #include <exception>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/program_options.hpp> 
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <gdal_priv.h>
 
-#include "cell.h"
-#include "util.h"
-#include "fill.h"
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include "allocprofile.h"
+#include "gridfile.h"
+#include "progress.h"
+#include "reader.h"
+#include "terrain.h"
+#include "timings.h"
+#include "tsvwriter.h"
 
 using namespace std;
 namespace po = boost::program_options;
@@ -48,35 +59,83 @@ namespace fs = boost::filesystem;
 struct Metadata
 {
 	public:
+	int cellsX, cellsY;
 	double physicalSize, originX, originY;
+	double geoTransform[6];
 	string projection;	
-};
+};
+
+//what to write out for each DEM, besides the grid file
+struct OutputOptions
+{
+	bool cmdOut;				//everything on standard-out, too
+	bool tsvOut;				//the grids as text, too
+	Compression compression;	//of the text
+	Timings *timings;			//to time each writer with, if any
+	OutputOptions() : cmdOut(false), tsvOut(false), compression(uncompressed), timings(NULL) {}
+};
+
+//an earlier run to bring up to date instead of starting over; see --update
+struct UpdateOptions
+{
+	string previous;			//the base name of its outputs; empty for a whole run
+	int x, y, width, height;	//the cells that changed since
+	UpdateOptions() : x(0), y(0), width(0), height(0) {}
+};
+
+//Closes a GDAL dataset when it goes, unless it was closed already.
+class DatasetCloser
+{
+	public:
+	DatasetCloser(GDALDataset *dataset) : dataset(dataset) {}
+	~DatasetCloser() {close();}
+	void close()
+	{
+		if(dataset) GDALClose((GDALDatasetH)dataset);
+		dataset = NULL;
+	}
+	
+	private:
+	GDALDataset *dataset;
+	DatasetCloser(const DatasetCloser&);
+	DatasetCloser& operator=(const DatasetCloser&);
+};
 
 extern Logger lg;
-extern Cell *dem;
-float *pafScanline;
-fs::ofstream *sDem, *meta, *flowDir, *flowTotal;
-
-bool cmdIn = false, fileOut = false, cmdOut = false, sendEOF = false;
 
 int main(int argc, char* argv[]);
 
-// Fills the DEM matrix using data provided in linear form.
-void linearTo2d(int firstRow, int end);
-
-/*	Creates flow records for the Flow Total Grid in a certain part of the DEM.
-	Usually called multiple times in parallel, on different
-	parts of the DEM.
-	start and end refer to positions in a linear collection of all the
-	EDGE cells of the DEM.
+/*	Find the streams of one DEM, and write them to files with the base name
+	outfile (unless it's empty) and as the output options say. Takes the
+	dataset, and closes it once it has been read. With an earlier run to
+	update, only what the change reaches is done again. Throws runtime_error,
+	with a message for the user, if it can't.
 */
-void flowTrace(unsigned long start, unsigned long end);
-
-void writeSdem();
-void writeMeta(Metadata& iniData);
-void writeFlowDir();
-void writeFlowTotal();
-
-void writeStdOut(Metadata& iniData);
+void streamDem(GDALDataset *poDataset, const string& outfile,
+				const TerrainOptions& options, const OutputOptions& output,
+				const UpdateOptions& update = UpdateOptions());
+
+// Runs a writer on a thread of its own, timed as a phase of its own if there
+// are timings. A writer on one thread is timed by that thread's CPU time.
+void startWriter(boost::thread_group& writers, Timings *timings, const string& name,
+				long long cells, int threads, const boost::function<void ()>& write);
+void timeWriter(Timings *timings, const string& name, long long cells, int threads,
+				boost::function<void ()> write);
+
+// Writes a finished grid into its layer of the grid file.
+void writeGridLayer(GridFileWriter *grids, int layer, const void *cells);
+// Put one row of a grid into a TSV file.
+typedef boost::function<void (TsvWriter&, int)> RowFormatter;
+void sdemRow(GridView<float> grid, TsvWriter& tsv, int row);
+void sdemRowFixed(GridView<float> grid, TsvWriter& tsv, int row);
+void flowDirRow(GridView<unsigned char> grid, TsvWriter& tsv, int row);
+void flowTotalRow(GridView<unsigned long long> grid, TsvWriter& tsv, int row);
+
+// Writes a grid to a TSV file, formatting its rows on the given number of
+// threads, and closes the file.
+void writeTsv(TsvFile *file, int rows, int columns, int threads, RowFormatter formatRow);
+void writeMeta(fs::ofstream *meta, Metadata& iniData);
+
+void writeStdOut(Metadata& iniData, const Terrain *terrain, int threads);
 
 #endif
@@ -0,0 +1,148 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "progress.h"
+#include "timings.h"
+
+namespace pt = boost::posix_time;
+
+bool Progress::reporting = false;
+int Progress::fd = -1;
+const char *Progress::phaseName = "start";
+long long Progress::total = 0;
+boost::atomic<long long> Progress::done(0);
+pt::ptime Progress::started;
+boost::mutex Progress::phase_mutex;
+boost::thread *Progress::reporter = NULL;
+Timings *Progress::timings = NULL;
+int Progress::timedPhase = -1;
+Progress::PhaseListener Progress::listener = NULL;
+
+void Progress::start(int fd)
+{
+	Progress::fd = fd;
+	started = pt::microsec_clock::universal_time();
+	reporting = true;
+	reporter = new boost::thread(report);
+}
+
+void Progress::timeWith(Timings *timings)
+{
+	Progress::timings = timings;
+}
+
+void Progress::listen(PhaseListener listener)
+{
+	boost::mutex::scoped_lock lock(phase_mutex);
+	Progress::listener = listener;
+}
+
+void Progress::stop()
+{
+	PhaseListener last;
+	{
+		boost::mutex::scoped_lock lock(phase_mutex);
+		if(timings && timedPhase >= 0) timings->end(timedPhase);
+		timings = NULL;
+		timedPhase = -1;
+		last = listener;
+		listener = NULL;
+	}
+	if(last) last("done");
+	if(!reporting) return;
+	reporter->interrupt();
+	reporter->join();
+	delete reporter;
+	reporter = NULL;
+	
+	phase("done", total);
+	done = total;
+	write();
+	reporting = false;
+}
+
+void Progress::phase(const char *name, long long total, int threads)
+{
+	PhaseListener tell;
+	{
+		boost::mutex::scoped_lock lock(phase_mutex);
+		phaseName = name;
+		Progress::total = total;
+		done = 0;
+		if(timings)
+		{
+			if(timedPhase >= 0) timings->end(timedPhase);
+			timedPhase = timings->begin(name, total, threads);
+		}
+		tell = listener;
+	}
+	if(tell) tell(name);
+}
+
+void Progress::report()
+{
+	const char *lastPhase = NULL;
+	long long lastDone = -1;
+	try{
+		while(true)
+		{
+			boost::this_thread::sleep(pt::milliseconds(100));
+			const char *phase;
+			{
+				boost::mutex::scoped_lock lock(phase_mutex);
+				phase = phaseName;
+			}
+			long long now = done.load(boost::memory_order_relaxed);
+			if(phase != lastPhase || now != lastDone) write();
+			lastPhase = phase;
+			lastDone = now;
+		}
+	}catch(boost::thread_interrupted&){}
+}
+
+void Progress::write()
+{
+	char record[256];
+	int length;
+	{
+		boost::mutex::scoped_lock lock(phase_mutex);
+		double elapsed = (pt::microsec_clock::universal_time() - started).total_microseconds() / 1e6;
+		length = snprintf(record, sizeof(record),
+			"{\"phase\":\"%s\",\"cells_done\":%lld,\"cells_total\":%lld,\"elapsed\":%.3f}\n",
+			phaseName, min(done.load(), total), total, elapsed);
+	}
+	for(int sent = 0, count; sent < length; sent += count)
+	{
+#ifdef _WIN32
+		count = _write(fd, record + sent, length - sent);
+#else
+		count = ::write(fd, record + sent, length - sent);
+#endif
+		if(count <= 0) break;
+	}
+}
@@ -0,0 +1,77 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+class Timings;
+
+/*	Reports how far along stream is, as lines of JSON on a file descriptor, for
+	the GUI or whatever else runs stream:
+	{"phase":"fill","cells_done":1200,"cells_total":800000,"elapsed":3.141}
+	The work just adds to a counter now and then, a row or so at a time. A
+	thread of its own writes a record when something has changed, at most every
+	100 ms. Nothing is counted or written unless start() was called.
+	The phases can be timed too, whether or not they are reported.
+*/
+class Progress
+{
+	public:
+	//report to the given file descriptor from now on
+	static void start(int fd);
+	//write the last record, with the phase "done", and stop reporting
+	static void stop();
+	
+	//time each phase from now on, until stop()
+	static void timeWith(Timings *timings);
+	//call this with the name of each phase as it starts, and with "done" at stop()
+	typedef void (*PhaseListener)(const char *name);
+	static void listen(PhaseListener listener);
+	
+	//a new phase, with this many cells (or other things) of work to do on this many threads
+	static void phase(const char *name, long long total, int threads = 1);
+	static void advance(long long cells)
+	{
+		if(reporting) done.fetch_add(cells, boost::memory_order_relaxed);
+	}
+	
+	private:
+	static bool reporting;
+	static int fd;
+	static const char *phaseName;
+	static long long total;
+	static boost::atomic<long long> done;
+	static boost::posix_time::ptime started;
+	static boost::mutex phase_mutex;
+	static boost::thread *reporter;
+	static Timings *timings;
+	static int timedPhase;
+	static PhaseListener listener;
+	
+	static void report();
+	static void write();
+};
+
+#endif
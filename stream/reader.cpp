@@ -0,0 +1,79 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "reader.h"
+
+RasterReader::RasterReader(GDALRasterBand *band, GridView<float> grid)
+	: band(band), grid(grid), cellsY(grid.height()), cellsX(grid.width()), rowsRead(0),
+	done(false), failed(false), reader(NULL)
+{}
+
+RasterReader::~RasterReader()
+{
+	join();
+}
+
+void RasterReader::start()
+{
+	if(!reader) reader = new boost::thread(&RasterReader::read, this);
+}
+
+int RasterReader::waitForRows(int rows)
+{
+	boost::mutex::scoped_lock lock(progress_mutex);
+	while(rowsRead < rows && !done) progress.wait(lock);
+	return rowsRead;
+}
+
+bool RasterReader::join()
+{
+	if(reader)
+	{
+		reader->join();
+		delete reader;
+		reader = NULL;
+	}
+	return !failed;
+}
+
+void RasterReader::read()
+{
+	int blockXSize, blockYSize;
+	band->GetBlockSize(&blockXSize, &blockYSize);
+	if(blockYSize < 1) blockYSize = 1;
+	
+	for(int row = 0; row < cellsY; row += blockYSize)
+	{
+		int rows = min(blockYSize, cellsY - row);
+		if(band->RasterIO(GF_Read, 0, row, cellsX, rows, grid.row(row),
+							cellsX, rows, GDT_Float32, 0, grid.stride()*sizeof(float)) != CE_None)
+		{
+			failed = true;
+			break;
+		}
+		Progress::advance((long long)rows*cellsX);
+		boost::mutex::scoped_lock lock(progress_mutex);
+		rowsRead = row + rows;
+		progress.notify_all();
+	}
+	
+	boost::mutex::scoped_lock lock(progress_mutex);
+	done = true;
+	progress.notify_all();
+}
@@ -0,0 +1,66 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef READER_H
+#define READER_H
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+#include <gdal_priv.h>
+
+#include "grid.h"
+#include "progress.h"
+
+using namespace std;
+
+/*	Reads a raster band into memory on a thread of its own, one row of the
+	band's native blocks at a time, so each block is decoded only once. Other
+	threads can start on the rows that have arrived while the rest are read.
+*/
+class RasterReader
+{
+	public:
+	//the grid must be the size of the band, whose values are converted to float
+	RasterReader(GDALRasterBand *band, GridView<float> grid);
+	~RasterReader();
+	
+	void start();
+	/*	Wait until at least the given number of rows are in the buffer, or the
+		reading stops. Returns the number of rows that are in.
+	*/
+	int waitForRows(int rows);
+	//wait for the whole band. Returns false if it couldn't all be read
+	bool join();
+	
+	private:
+	GDALRasterBand *band;
+	GridView<float> grid;
+	int cellsY, cellsX;
+	int rowsRead;
+	bool done, failed;
+	boost::mutex progress_mutex;
+	boost::condition_variable progress;
+	boost::thread *reader;
+	
+	void read();
+};
+
+#endif
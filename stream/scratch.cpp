@@ -0,0 +1,101 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+
+#include "scratch.h"
+
+namespace ip = boost::interprocess;
+namespace fs = boost::filesystem;
+
+string Scratch::directory;
+long Scratch::files = 0;
+map<void*, Scratch::Mapping> Scratch::mappings;
+boost::mutex Scratch::mappings_mutex;
+
+void Scratch::useDirectory(const string& dir)
+{
+	directory = dir;
+}
+
+bool Scratch::outOfCore()
+{
+	return !directory.empty();
+}
+
+void* Scratch::allocateBytes(long bytes)
+{
+	if(!outOfCore())
+	{
+		//start on a cache line, with the real start of the block just before it
+		char *block = new char[bytes + ALIGN];
+		char *array = block + ALIGN - (size_t)block % ALIGN;
+		reinterpret_cast<char**>(array)[-1] = block;
+		return array;
+	}
+	if(bytes < 1) bytes = 1;
+	
+	Mapping mapping;
+	{
+		boost::mutex::scoped_lock lock(mappings_mutex);
+		ostringstream name;
+		name << "stream-" << files++ << ".scratch";
+		mapping.path = (fs::path(directory) / name.str()).string();
+	}
+	
+	//make a file of the right size, then map all of it
+	{
+		filebuf file;
+		file.open(mapping.path.c_str(), ios_base::in | ios_base::out | ios_base::trunc | ios_base::binary);
+		if(!file.is_open()) throw runtime_error("couldn't create " + mapping.path);
+		file.pubseekoff(bytes-1, ios_base::beg);
+		file.sputc(0);
+	}
+	ip::file_mapping file(mapping.path.c_str(), ip::read_write);
+	mapping.region = new ip::mapped_region(file, ip::read_write);
+	
+	boost::mutex::scoped_lock lock(mappings_mutex);
+	void *array = mapping.region->get_address();
+	mappings[array] = mapping;
+	return array;
+}
+
+void Scratch::release(void *array)
+{
+	if(!array) return;
+	Mapping mapping;
+	{
+		boost::mutex::scoped_lock lock(mappings_mutex);
+		map<void*, Mapping>::iterator found = mappings.find(array);
+		if(found == mappings.end())
+		{
+			delete[] static_cast<char**>(array)[-1];
+			return;
+		}
+		mapping = found->second;
+		mappings.erase(found);
+	}
+	delete mapping.region;
+	ip::file_mapping::remove(mapping.path.c_str());
+}
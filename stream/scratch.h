@@ -0,0 +1,69 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <map>
+#include <string>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/*	Hands out the memory for the big per-cell arrays. Normally that is plain
+	heap memory, but in out-of-core mode every array is a memory-mapped scratch
+	file instead, so the operating system can page grids bigger than RAM in and
+	out of the disk.
+*/
+class Scratch
+{
+	public:
+	//Keep the arrays in scratch files in the given directory from now on.
+	static void useDirectory(const string& dir);
+	static bool outOfCore();
+	
+	template<typename T>
+	static T* allocate(long count)
+	{
+		return static_cast<T*>(allocateBytes(count * sizeof(T)));
+	}
+	//Give back an array from allocate(). NULL is ignored.
+	static void release(void *array);
+	
+	//every array starts on a multiple of this many bytes
+	static const size_t ALIGN = 64;
+	
+	private:
+	struct Mapping
+	{
+		boost::interprocess::mapped_region *region;
+		string path;
+	};
+	
+	static string directory;
+	static long files;			//scratch files made so far, to give unique names
+	static map<void*, Mapping> mappings;
+	static boost::mutex mappings_mutex;
+	
+	static void* allocateBytes(long bytes);
+};
+
+#endif
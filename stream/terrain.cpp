@@ -0,0 +1,194 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+
+#include "terrain.h"
+
+Terrain::Terrain(int cellsY, int cellsX, const TerrainOptions& options)
+	: options(options), cells(cellsY, cellsX), planchon(NULL),
+	flowKernel(flowDirsKernel(options.flow)), rowsIn(0)
+{
+	if(cellsY < 2 || cellsX < 2)
+		throw invalid_argument("a DEM needs at least 2 rows and 2 columns");
+	if(this->options.threads < 1) this->options.threads = 1;
+	if(this->options.threads > cellsY) this->options.threads = cellsY;
+	//The Planchon-Darboux filler is set up as the rows come in.
+	if(options.fill == fillPlanchon)
+		planchon = new FillSinks(cells.height, 0.00/*1*/, this->options.threads);
+}
+
+Terrain::~Terrain()
+{
+	delete planchon;
+}
+
+void Terrain::setElevation(const float *heights)
+{
+	copy(heights, heights + cells.height.size(), cells.height.data());
+	rowsReady(height());
+}
+
+void Terrain::rowsReady(int end)
+{
+	if(end <= rowsIn) return;
+	//the cells are made as their rows come in, while the rest are still read
+	setUpRows(rowsIn, end);
+	if(planchon) planchon->prepareRows(rowsIn, end);
+	rowsIn = end;
+}
+
+void Terrain::run()
+{
+	fill();
+	findStreams();
+}
+
+void Terrain::update(const TerrainResults& before, int y, int x, int rows, int columns)
+{
+	if(options.fill == fillPriorityFlood)
+		throw invalid_argument("the results of a priority-flood fill can't be updated");
+	if(before.filled.height() != height() || before.filled.width() != width()
+		|| before.flowDirections.height() != height() || before.flowDirections.width() != width()
+		|| before.flowTotals.height() != height() || before.flowTotals.width() != width())
+		throw invalid_argument("the earlier results aren't the size of the DEM");
+	if(rows < 1 || columns < 1 || y < 0 || x < 0 || y + rows > height() || x + columns > width())
+		throw invalid_argument("the changed window isn't inside the DEM");
+	rowsReady(height());
+	WindowUpdate updater(cells, before, flowKernel);
+	updater.run(y, x, rows, columns);
+}
+
+void Terrain::fill()
+{
+	//any rows the caller didn't say were ready
+	rowsReady(height());
+	const long long total = (long long)height() * width();
+
+	//Fill in the sinkholes!
+	LOG(normal, "Filling sinkholes...\n");
+	Progress::phase("fill", total, options.fill == fillPriorityFlood ? 1 : options.threads);
+	if(options.fill == fillPriorityFlood)
+	{
+		PriorityFlood filler(cells.height, 0.00);
+		filler.fill(cells.flowDir);
+	}else if(options.fill == fillTiled){
+		TiledFlood filler(cells.height, options.threads);
+		filler.fill();	//counts its own progress, a strip at a time
+	}else{
+		planchon->fill();
+	}
+	if(options.fill != fillTiled) Progress::advance(total);
+}
+
+void Terrain::findStreams()
+{
+	const long long total = (long long)height() * width();
+	//the flood already chose the flow directions
+	if(options.fill != fillPriorityFlood)
+	{
+		Progress::phase("directions", total - 2*width(), options.threads);	//not the top and bottom rows
+		onRows(&Terrain::findFlowDirs);
+
+		//one way off every flat, so the trace has no ties to settle
+		LOG(normal, "Draining flats...\n");
+		Progress::phase("flats", total);
+		FlatResolver flats(cells.height, cells.flowDirSet, cells.noData);
+		long flatCells = flats.resolve();
+		LOG(debug, flatCells << " cells on flats\n");
+		Progress::advance(total);
+	}
+
+	//Now do calculations.
+	LOG(normal, "\nCalculating...\n");
+
+	//make flow total grid
+	LOG(normal, "\nFinding streams...\n");
+	if(options.fill != fillPriorityFlood)
+	{
+		Progress::phase("trace", cells.flowDir.borderSize(), options.threads);
+		cells.traceFlowDirs(options.threads);
+	}
+	lg.write(progress, '\n');
+	Progress::phase("accumulate", total, options.threads);
+	cells.accumulate(options.threads);
+	Progress::advance(total);
+}
+
+void Terrain::onRows(void (Terrain::*work)(int, int))
+{
+	int threads = options.threads;
+	int rowsPerThread = height() / threads;
+	boost::thread_group workers;
+	for(int thread=0; thread<(threads-1); thread++)
+	{
+		int firstRow = thread*rowsPerThread;
+		workers.add_thread(new boost::thread(work, this, firstRow, firstRow+rowsPerThread));
+	}
+	(this->*work)((threads-1)*rowsPerThread, height());
+	workers.join_all();
+}
+
+void Terrain::setUpRows(int firstRow, int end)
+{
+	const int cellsY = height(), cellsX = width();
+	int yp = firstRow;
+	if(firstRow == 0)
+	{
+		cells.fill(yp, 0, northwest);
+		for(int xp = 1; xp<(cellsX-1); xp++)
+		{
+			cells.fill(yp, xp, north);
+		}
+		cells.fill(yp, cellsX-1, northeast);
+		yp++;
+	}
+	int lastNormRow = (end==cellsY) ? end-1 : end;
+	for(; yp<lastNormRow; yp++)
+	{
+		lg.write(progress, '-');
+		cells.fill(yp, 0, west);
+		for(int xp = 1; xp<(cellsX-1); xp++)
+		{
+			cells.fill(yp, xp);
+		}
+		cells.fill(yp, cellsX-1, east);
+	}
+	if(lastNormRow != end)
+	{
+		cells.fill(yp, 0, southwest);
+		for(int xp = 1; xp<(cellsX-1); xp++)
+		{
+			cells.fill(yp, xp, south);
+		}
+		cells.fill(yp, cellsX-1, southeast);
+	}
+}
+
+void Terrain::findFlowDirs(int firstRow, int end)
+{
+	//the cells on the outside already have their directions, but not their bits
+	if(firstRow == 0) cells.findNoData(0);
+	if(end == height()) cells.findNoData(height()-1);
+	for(int yp = max(firstRow, 1); yp < min(end, height()-1); yp++)
+	{
+		cells.findFlowDirs(yp, flowKernel);
+		Progress::advance(width());
+	}
+}
@@ -0,0 +1,123 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "cell.h"
+#include "fill.h"
+#include "flats.h"
+#include "flood.h"
+#include "flowdir.h"
+#include "grid.h"
+#include "update.h"
+
+/*	The terrain analysis that stream does, as a library (libstream) for
+	programs that have their elevations in memory already. Nothing in here
+	touches files or GDAL, and the grids and results of one Terrain are its
+	own, so a program can analyze any number of DEMs, one after another or at
+	the same time. What every Terrain does share is the process's reporting:
+	they all log to lg, and tell Progress (and so any Timings or listener
+	given to it) which phase they are in. With more than one at once, the
+	log lines are mixed and the phases of one cut into those of another, so
+	stream --batch doesn't allow --progress-fd, --timings or --alloc-profile.
+	For example:
+		Terrain terrain(rows, columns);
+		terrain.setElevation(heights);
+		terrain.run();
+		GridView<unsigned long long> totals = terrain.flowTotals();
+*/
+
+//how sinkholes are filled; see FillSinks, PriorityFlood and TiledFlood
+enum FillMethod
+{
+	fillPlanchon,
+	fillPriorityFlood,		//also finds the flow directions, so is much faster
+	fillTiled
+};
+
+struct TerrainOptions
+{
+	FillMethod fill;
+	FlowMethod flow;	//how the flow directions are found, unless the fill finds them
+	int threads;
+	TerrainOptions() : fill(fillPlanchon), flow(lowest), threads(4) {}
+};
+
+class Terrain
+{
+	public:
+	Terrain(int cellsY, int cellsX, const TerrainOptions& options = TerrainOptions());
+	~Terrain();
+
+	int height() const {return cells.cellsY;}
+	int width() const {return cells.cellsX;}
+
+	//The elevations in meters, for the caller to put in place before run().
+	GridView<float> elevation() {return cells.height;}
+	//Copy the elevations in from height()*width() values in row-major order.
+	void setElevation(const float *heights);
+	/*	Say that the elevations of the rows before end are in place, so work
+		on them can start while the rest are still arriving. This is optional,
+		and the rows must be given in order.
+	*/
+	void rowsReady(int end);
+	//The value that marks cells with no data. Without one, it's any height below -500 m.
+	void setNoDataValue(float value) {cells.setNoDataValue(value);}
+
+	//Fill the sinkholes, then find the streams.
+	void run();
+	/*	Instead of run(), bring the results of a run on this DEM from before
+		its heights changed up to date. Only the rows and columns given may
+		have changed, and the earlier run must have used the same options.
+		It redoes only the part of the work that the change reaches; see
+		WindowUpdate. The results of a fillPriorityFlood run can't be updated,
+		since that fill chooses the flow directions its own way. Throws
+		invalid_argument if the results or the window don't fit the DEM.
+	*/
+	void update(const TerrainResults& before, int y, int x, int rows, int columns);
+	//The two halves of run(), for callers that want the filled DEM early.
+	void fill();
+	void findStreams();
+
+	//The results, which are good for as long as the Terrain is.
+	GridView<float> filled() const {return cells.height;}
+	GridView<unsigned char> flowDirections() const {return cells.flowDir;}
+	GridView<unsigned long long> flowTotals() const {return cells.flowTotal;}
+
+	private:
+	TerrainOptions options;
+	CellGrid cells;
+	FillSinks *planchon;	//made early, so it can prepare rows as they come in
+	FlowDirsKernel flowKernel;		//for the flow method, chosen once
+	int rowsIn;
+
+	//run one of the below on bands of rows, one band per thread
+	void onRows(void (Terrain::*work)(int, int));
+	//give the cells on the outside their outward flow directions
+	void setUpRows(int firstRow, int end);
+	//find the possible flow directions of the cells
+	void findFlowDirs(int firstRow, int end);
+
+	//one owner only
+	Terrain(const Terrain&);
+	Terrain& operator=(const Terrain&);
+};
+
+#endif
@@ -0,0 +1,184 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMINGS_H
+#define TIMINGS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX	//so windows.h leaves std::min and std::max alone
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*	Times the phases of a run, for --timings, and writes them out as JSON:
+	{"program":"stream","wall":4.210,"cpu":12.870,"peak_rss_kb":81234,"phases":[
+	 {"name":"fill","cells":1800000,"threads":4,"wall":1.020,"cpu":3.950,
+	  "cells_per_s":1764705.9,"peak_rss_kb":80112}, ...]}
+	Phases may overlap, and be begun and ended on any thread. The CPU time of a
+	phase is that of the whole process while it ran, unless it is timed by the
+	thread it runs on alone; the peak RSS is the process's, up to its end.
+	This header is shared by stream and zone. On Windows the times and the peak
+	working set come from the Win32 API, which needs -lpsapi.
+*/
+class Timings
+{
+	public:
+	//whose CPU time a phase counts
+	enum Clock
+	{
+		process,
+		thread		//the thread that begins and ends the phase, which must be the same one
+	};
+
+	Timings(const std::string& program)
+		: program(program), started(now()), startedCpu(cpuTime(process))
+	{}
+
+	//a phase starting now, over this many cells, on this many threads; returns its number
+	int begin(const std::string& name, long long cells, int threads, Clock clock = process)
+	{
+		Phase phase;
+		phase.name = name;
+		phase.cells = cells;
+		phase.threads = threads;
+		phase.clock = clock;
+		phase.started = now();
+		phase.startedCpu = cpuTime(clock);
+		phase.wall = phase.cpu = 0;
+		phase.peakRss = 0;
+		phase.ended = false;
+		boost::mutex::scoped_lock lock(phases_mutex);
+		phases.push_back(phase);
+		return (int)phases.size() - 1;
+	}
+
+	void end(int number)
+	{
+		boost::mutex::scoped_lock lock(phases_mutex);
+		Phase& phase = phases[number];
+		if(phase.ended) return;
+		phase.wall = now() - phase.started;
+		phase.cpu = cpuTime(phase.clock) - phase.startedCpu;
+		phase.peakRss = peakRss();
+		phase.ended = true;
+	}
+
+	//write every phase that has ended to the file; false if it couldn't be
+	bool write(const std::string& path) const
+	{
+		FILE *out = fopen(path.c_str(), "w");
+		if(out == NULL) return false;
+		fprintf(out, "{\"program\":\"%s\",\"wall\":%.3f,\"cpu\":%.3f,\"peak_rss_kb\":%ld,\"phases\":[",
+				program.c_str(), now() - started, cpuTime(process) - startedCpu, peakRss());
+		boost::mutex::scoped_lock lock(phases_mutex);
+		bool first = true;
+		for(size_t i = 0; i < phases.size(); i++)
+		{
+			const Phase& phase = phases[i];
+			if(!phase.ended) continue;
+			fprintf(out, "%s\n {\"name\":\"%s\",\"cells\":%lld,\"threads\":%d,\"wall\":%.3f,\"cpu\":%.3f,"
+					"\"cells_per_s\":%.1f,\"peak_rss_kb\":%ld}",
+					first ? "" : ",", phase.name.c_str(), phase.cells, phase.threads, phase.wall,
+					phase.cpu, phase.wall > 0 ? phase.cells / phase.wall : 0.0, phase.peakRss);
+			first = false;
+		}
+		fprintf(out, "]}\n");
+		return fclose(out) == 0;
+	}
+
+	private:
+	struct Phase
+	{
+		std::string name;
+		long long cells;
+		int threads;
+		Clock clock;
+		double started, startedCpu;
+		double wall, cpu;	//in seconds
+		long peakRss;		//in kB
+		bool ended;
+	};
+
+	std::string program;
+	double started, startedCpu;
+	std::vector<Phase> phases;
+	mutable boost::mutex phases_mutex;
+
+	//seconds since some fixed time
+	static double now()
+	{
+		static const boost::posix_time::ptime epoch(boost::gregorian::date(2000, 1, 1));
+		return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+	}
+	//seconds of CPU time, in user and system code
+	static double cpuTime(Clock clock)
+	{
+#ifdef _WIN32
+		FILETIME created, exited, kernel, user;
+		if(clock == thread)
+			GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+		else
+			GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+		return (ticks(kernel) + ticks(user)) / 1e7;
+#else
+		struct rusage usage;
+#ifdef RUSAGE_THREAD
+		getrusage(clock == thread ? RUSAGE_THREAD : RUSAGE_SELF, &usage);
+#else
+		getrusage(RUSAGE_SELF, &usage);	//no way to ask about one thread
+#endif
+		return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+				+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+	}
+	//the most memory the process has had resident so far
+	static long peakRss()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_maxrss;
+#endif
+	}
+#ifdef _WIN32
+	//a FILETIME counts 100 ns ticks
+	static double ticks(const FILETIME& time)
+	{
+		return (double)(((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime);
+	}
+#endif
+};
+
+#endif
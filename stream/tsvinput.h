@@ -0,0 +1,161 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TSVINPUT_H
+#define TSVINPUT_H
+
+#include <deque>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/thread.hpp>
+
+/*	Finds the TSV file with the given name, or else the .tsv.zst or .tsv.gz file
+	that stream writes in its place when asked to compress. Returns the name
+	unchanged when there's none of them, so opening it fails as usual.
+*/
+inline std::string findTsv(const std::string& name)
+{
+	const char *endings[] = {"", ".zst", ".gz"};
+	for(int i = 0; i < 3; i++)
+	{
+		if(std::ifstream((name + endings[i]).c_str()))
+			return name + endings[i];
+	}
+	return name;
+}
+
+inline bool endsWith(const std::string& name, const std::string& ending)
+{
+	return name.size() >= ending.size()
+		&& name.compare(name.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+/*	Reads a TSV file through an istream, decompressing it first if its name
+	ends in .gz or .zst. A thread of its own reads and decompresses the file a
+	block at a time, a few blocks ahead of whoever is parsing them.
+	Shared by zone and the plotter.
+*/
+class TsvInput : public std::streambuf
+{
+	public:
+	TsvInput(const std::string& path)
+		: current(NULL), finished(false), stopping(false), failed(false), reader(NULL)
+	{
+		boost::iostreams::file_source file(path, std::ios_base::in | std::ios_base::binary);
+		opened = file.is_open();
+		if(!opened) return;
+		if(endsWith(path, ".gz"))
+			in.push(boost::iostreams::gzip_decompressor());
+		else if(endsWith(path, ".zst"))
+			in.push(boost::iostreams::zstd_decompressor());
+		in.push(file);
+		reader = new boost::thread(&TsvInput::read, this);
+	}
+	
+	~TsvInput()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			stopping = true;
+			changed.notify_all();
+		}
+		if(reader) reader->join();
+		delete reader;
+		delete current;
+		for(size_t i = 0; i < blocks.size(); i++) delete blocks[i];
+	}
+	
+	bool is_open() const {return opened;}
+	//true if the file turned out to be corrupt. Only known once it's all read
+	bool corrupt() const {return failed;}
+	
+	protected:
+	int_type underflow()
+	{
+		if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		delete current;
+		current = NULL;
+		
+		boost::mutex::scoped_lock lock(mutex);
+		while(blocks.empty() && !finished) changed.wait(lock);
+		if(blocks.empty()) return traits_type::eof();
+		current = blocks.front();
+		blocks.pop_front();
+		changed.notify_all();
+		
+		setg(&(*current)[0], &(*current)[0], &(*current)[0] + current->size());
+		return traits_type::to_int_type(*gptr());
+	}
+	
+	private:
+	enum {BLOCK_SIZE = 1 << 20, BLOCKS_AHEAD = 4};
+	
+	boost::iostreams::filtering_istream in;
+	std::deque<std::vector<char>*> blocks;	//read, and waiting to be parsed
+	std::vector<char> *current;				//the block being parsed
+	bool opened, finished, stopping, failed;
+	boost::mutex mutex;
+	boost::condition_variable changed;
+	boost::thread *reader;
+	
+	void read()
+	{
+		while(true)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				while(blocks.size() >= BLOCKS_AHEAD && !stopping) changed.wait(lock);
+				if(stopping) break;
+			}
+			
+			std::vector<char> *block = new std::vector<char>(BLOCK_SIZE);
+			std::streamsize got = 0;
+			try{
+				in.read(&(*block)[0], BLOCK_SIZE);
+				got = in.gcount();
+				//a decompressor that fails may only set badbit, not throw
+				if(in.bad()) failed = true;
+			}catch(std::exception&){
+				failed = true;
+			}
+			if(got <= 0)
+			{
+				delete block;
+				break;
+			}
+			block->resize(got);
+			
+			boost::mutex::scoped_lock lock(mutex);
+			blocks.push_back(block);
+			changed.notify_all();
+		}
+		boost::mutex::scoped_lock lock(mutex);
+		finished = true;
+		changed.notify_all();
+	}
+};
+
+#endif
@@ -0,0 +1,328 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/thread.hpp>
+
+#include "tsvwriter.h"
+
+//longest text a number can turn into, "-3.40282e+38" or a fixed float
+static const size_t MAX_NUMBER = 64;
+
+//powers of ten that doubles hold exactly
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+	1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22};
+
+//true for negative numbers and -0, which printf gives a sign
+static bool negative(double v)
+{
+	return v < 0 || (v == 0 && 1/v < 0);
+}
+
+/*	Rounds v*10^shift to the nearest whole number, if that can be done without
+	any doubt about a tie. v*10^shift must be under 2^53.
+*/
+static bool roundScaled(double v, int shift, double& rounded)
+{
+	if(shift > 22 || shift < -22) return false;
+	double scaled = shift >= 0 ? v * POW10[shift] : v / POW10[-shift];
+	double whole = floor(scaled);
+	//the scaling can be off in the last bit, so stay well clear of halfway
+	double frac = scaled - whole;
+	if(fabs(frac - 0.5) <= scaled * 1e-15 + 1e-9) return false;
+	rounded = frac > 0.5 ? whole + 1 : whole;
+	return true;
+}
+
+static char* writeDigits(char *p, unsigned long n, int count)
+{
+	for(int i = count-1; i >= 0; i--, n /= 10)
+		p[i] = '0' + n % 10;
+	return p + count;
+}
+
+//printf's "%.6g"
+static char* formatGeneral(char *p, double v)
+{
+	if(v != v || v - v != 0)
+		return p + sprintf(p, "%.6g", v);
+	if(v == 0)
+	{
+		if(negative(v)) *p++ = '-';
+		*p++ = '0';
+		return p;
+	}
+	if(v < 0)
+	{
+		*p++ = '-';
+		v = -v;
+	}
+	
+	//six significant digits, and the power of ten of the first one
+	int exponent = (int)floor(log10(v));
+	double rounded;
+	if(!roundScaled(v, 5-exponent, rounded))
+		return p + sprintf(p, "%.6g", v);
+	if(rounded < 100000)
+	{
+		//log10 came out just high
+		exponent--;
+		if(!roundScaled(v, 5-exponent, rounded))
+			return p + sprintf(p, "%.6g", v);
+	}
+	if(rounded >= 1000000)
+	{
+		//rounded up to the next power of ten
+		rounded /= 10;
+		exponent++;
+	}
+	char digits[6];
+	writeDigits(digits, (unsigned long)rounded, 6);
+	int significant = 6;
+	while(significant > 1 && digits[significant-1] == '0') significant--;
+	
+	if(exponent < -4 || exponent >= 6)
+	{
+		*p++ = digits[0];
+		if(significant > 1)
+		{
+			*p++ = '.';
+			for(int i = 1; i < significant; i++) *p++ = digits[i];
+		}
+		*p++ = 'e';
+		*p++ = exponent < 0 ? '-' : '+';
+		int e = exponent < 0 ? -exponent : exponent;
+		return writeDigits(p, e, e >= 100 ? 3 : 2);
+	}
+	if(exponent < 0)
+	{
+		*p++ = '0';
+		*p++ = '.';
+		for(int i = -1; i > exponent; i--) *p++ = '0';
+		for(int i = 0; i < significant; i++) *p++ = digits[i];
+		return p;
+	}
+	for(int i = 0; i <= exponent; i++) *p++ = digits[i];
+	if(significant > exponent+1)
+	{
+		*p++ = '.';
+		for(int i = exponent+1; i < significant; i++) *p++ = digits[i];
+	}
+	return p;
+}
+
+//printf's "%.6f"
+static char* formatFixed(char *p, double v)
+{
+	double rounded;
+	if(v != v || fabs(v) >= 1e9 || !roundScaled(fabs(v), 6, rounded))
+		return p + sprintf(p, "%.6f", v);
+	if(negative(v)) *p++ = '-';
+	unsigned long long n = (unsigned long long)rounded;
+	unsigned long whole = n / 1000000;
+	
+	char digits[10];
+	char *end = writeDigits(digits, whole, 10);
+	char *first = digits;
+	while(first < end-1 && *first == '0') first++;
+	while(first < end) *p++ = *first++;
+	*p++ = '.';
+	return writeDigits(p, n % 1000000, 6);
+}
+
+TsvWriter::TsvWriter(ostream& out, size_t chunkSize)
+	: out(&out), buffer(chunkSize + MAX_NUMBER), used(0)
+{}
+
+TsvWriter::TsvWriter()
+	: out(NULL), buffer(1 << 16), used(0)
+{}
+
+TsvWriter::~TsvWriter()
+{
+	flush();
+}
+
+void TsvWriter::put(float value)
+{
+	char *start = room();
+	used = formatGeneral(start, value) - &buffer[0];
+}
+
+void TsvWriter::putFixed(float value)
+{
+	char *start = room();
+	used = formatFixed(start, value) - &buffer[0];
+}
+
+void TsvWriter::put(int value)
+{
+	char *p = room();
+	unsigned int n = value;
+	if(value < 0)
+	{
+		*p++ = '-';
+		n = -n;
+	}
+	char digits[10];
+	char *end = digits + 10, *first = end;
+	do{
+		*--first = '0' + n % 10;
+		n /= 10;
+	}while(n);
+	while(first < end) *p++ = *first++;
+	used = p - &buffer[0];
+}
+
+void TsvWriter::flush()
+{
+	if(out) writeTo(*out);
+}
+
+void TsvWriter::writeTo(ostream& other)
+{
+	if(used) other.write(&buffer[0], used);
+	used = 0;
+}
+
+void TsvWriter::makeRoom()
+{
+	if(out)
+		flush();
+	else
+		buffer.resize(buffer.size() * 2);
+}
+
+char* TsvWriter::room()
+{
+	if(used + MAX_NUMBER > buffer.size()) makeRoom();
+	return &buffer[used];
+}
+
+TsvFile::TsvFile(const string& path, Compression compression)
+{
+	namespace io = boost::iostreams;
+	io::file_sink file(path, ios_base::out | ios_base::trunc | ios_base::binary);
+	opened = file.is_open();
+	//the grids compress well even at the fastest levels, which keep up with the disk
+	if(compression == gzipped)
+		push(io::gzip_compressor(io::gzip_params(io::gzip::best_speed)), 1 << 16);
+	else if(compression == zstandard)
+		push(io::zstd_compressor(io::zstd_params(1)), 1 << 16);
+	push(file, 1 << 16);
+}
+
+void TsvFile::close()
+{
+	reset();
+}
+
+const char* TsvFile::ending(Compression compression)
+{
+	switch(compression)
+	{
+		case gzipped:		return ".gz";
+		case zstandard:		return ".zst";
+		default:			return "";
+	}
+}
+
+//what the threads of writeRows share
+struct RowChunks
+{
+	int rows, chunkRows, threads;
+	boost::function<void (TsvWriter&, int)> formatRow;
+	int nextChunk, nextOut;
+	map<int, TsvWriter*> done;		//formatted chunks waiting their turn
+	boost::mutex mutex;
+	boost::condition_variable changed;
+};
+
+static void formatChunks(RowChunks *chunks)
+{
+	boost::mutex::scoped_lock lock(chunks->mutex);
+	while(chunks->nextChunk * chunks->chunkRows < chunks->rows)
+	{
+		//don't get too far ahead of the output, or the whole file piles up in memory
+		if(chunks->nextChunk - chunks->nextOut >= 2 * chunks->threads)
+		{
+			chunks->changed.wait(lock);
+			continue;
+		}
+		int chunk = chunks->nextChunk++;
+		lock.unlock();
+		
+		TsvWriter *tsv = new TsvWriter;
+		int first = chunk * chunks->chunkRows;
+		int end = min(first + chunks->chunkRows, chunks->rows);
+		for(int row = first; row < end; row++)
+			chunks->formatRow(*tsv, row);
+		
+		lock.lock();
+		chunks->done[chunk] = tsv;
+		chunks->changed.notify_all();
+	}
+}
+
+void writeRows(ostream& out, int rows, int cellsPerRow, int threads,
+				boost::function<void (TsvWriter&, int)> formatRow)
+{
+	RowChunks chunks;
+	chunks.rows = rows;
+	//about a megabyte of text a chunk
+	chunks.chunkRows = max(1, (1 << 17) / max(cellsPerRow, 1));
+	chunks.threads = max(threads, 1);
+	chunks.formatRow = formatRow;
+	chunks.nextChunk = chunks.nextOut = 0;
+	
+	boost::thread_group formatters;
+	for(int thread = 0; thread < chunks.threads; thread++)
+		formatters.add_thread(new boost::thread(formatChunks, &chunks));
+	
+	//this thread writes the chunks in order as they're finished
+	int chunkCount = (rows + chunks.chunkRows - 1) / chunks.chunkRows;
+	boost::mutex::scoped_lock lock(chunks.mutex);
+	for(; chunks.nextOut < chunkCount; )
+	{
+		map<int, TsvWriter*>::iterator next = chunks.done.find(chunks.nextOut);
+		if(next == chunks.done.end())
+		{
+			chunks.changed.wait(lock);
+			continue;
+		}
+		TsvWriter *tsv = next->second;
+		chunks.done.erase(next);
+		lock.unlock();
+		tsv->writeTo(out);
+		delete tsv;
+		lock.lock();
+		chunks.nextOut++;
+		chunks.changed.notify_all();
+	}
+	lock.unlock();
+	formatters.join_all();
+}
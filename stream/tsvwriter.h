@@ -0,0 +1,101 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TSVWRITER_H
+#define TSVWRITER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+using namespace std;
+
+/*	Formats numbers into a big buffer and hands it to the stream a few
+	megabytes at a time, instead of going through operator<< cell by cell.
+	The text is exactly what operator<< would give in the "C" locale.
+*/
+class TsvWriter
+{
+	public:
+	TsvWriter(ostream& out, size_t chunkSize = 1 << 22);
+	//keeps all the text in memory until writeTo()
+	TsvWriter();
+	~TsvWriter();
+	
+	//like out << value
+	void put(float value);
+	//like out << fixed << value, with the default precision of 6
+	void putFixed(float value);
+	void put(int value);
+	void put(char c)
+	{
+		if(used == buffer.size()) makeRoom();
+		buffer[used++] = c;
+	}
+	//send everything so far to the stream
+	void flush();
+	//send everything so far to the given stream instead
+	void writeTo(ostream& other);
+	
+	private:
+	ostream *out;
+	vector<char> buffer;
+	size_t used;
+	
+	void makeRoom();
+	//make sure there's room for a number
+	char* room();
+};
+
+enum Compression
+{
+	uncompressed,
+	gzipped,
+	zstandard
+};
+
+/*	A TSV output file, compressed on its way to disk if asked. Whichever thread
+	writes to it does the compressing; for writeRows() that isn't one of the
+	threads formatting the rows, so the two go on at the same time.
+*/
+class TsvFile : public boost::iostreams::filtering_ostream
+{
+	public:
+	TsvFile(const string& path, Compression compression);
+	bool is_open() const {return opened;}
+	//finish compressing, and close the file
+	void close();
+	//what goes after ".tsv" in the file name
+	static const char* ending(Compression compression);
+	
+	private:
+	bool opened;
+};
+
+/*	Writes rows of text to out, formatting chunks of them on several threads at
+	once. formatRow(tsv, row) puts one whole row, newline and all, into tsv.
+	The chunks go out in order, while the threads go on to later ones.
+*/
+void writeRows(ostream& out, int rows, int cellsPerRow, int threads,
+				boost::function<void (TsvWriter&, int)> formatRow);
+
+#endif
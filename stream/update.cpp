@@ -0,0 +1,351 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include "update.h"
+
+//row and column offsets to the neighbor in each direction
+static const int dY[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+static const int dX[8] = { 0, 1, 1, 1, 0, -1, -1, -1};
+
+//where water goes: not looked up yet, through the area, or off the DEM another way
+static const unsigned char UNKNOWN = 0;
+static const unsigned char INTO_AREA = 1;
+static const unsigned char ELSEWHERE = 2;
+static const unsigned char FOLLOWING = 3;	//on the way being followed
+
+//marks for redirect()
+static const unsigned char REDO = 1;		//its directions are found again
+static const unsigned char SEEN = 2;		//on a flat that has been gone over
+
+//how many cells the area grows past the ring at least, each time it grows
+static const int GROW_MARGIN = 16;
+
+WindowUpdate::WindowUpdate(CellGrid& cells, const TerrainResults& before, FlowDirsKernel kernel)
+	: cellsY(cells.cellsY), cellsX(cells.cellsX), cells(cells), before(before), kernel(kernel),
+	top(0), left(0), bottom(0), right(0), marks(cells.cellsY, cells.cellsX)
+{
+	fill_n(marks.data(), marks.size(), UNKNOWN);
+}
+
+void WindowUpdate::run(int y, int x, int rows, int columns)
+{
+	top = y;
+	left = x;
+	bottom = y + rows;
+	right = x + columns;
+
+	LOG(normal, "Filling sinkholes around the change...\n");
+	int floods = 1;
+	while(!refill()) floods++;
+	LOG(debug, "Flooded " << floods << " time(s), over rows " << top << " to " << bottom
+		<< " and columns " << left << " to " << right << '\n');
+
+	LOG(normal, "Finding streams...\n");
+	redirect();
+}
+
+bool WindowUpdate::refill()
+{
+	//the area, and the ring around it
+	const int boxTop = max(top-1, 0), boxLeft = max(left-1, 0);
+	const int boxY = min(bottom+1, cellsY) - boxTop, boxX = min(right+1, cellsX) - boxLeft;
+	//and a collar around that, for the second flood to find ways around the area
+	const int collar = max(GROW_MARGIN, max(bottom - top, right - left)/2);
+	const int outTop = max(top-collar, 0), outLeft = max(left-collar, 0);
+	const int outY = min(bottom+collar, cellsY) - outTop, outX = min(right+collar, cellsX) - outLeft;
+	Progress::phase("fill", (long long)boxY * boxX + (long long)outY * outX);
+
+	Grid<float> water(boxY, boxX);
+	for(int y = 0; y < boxY; y++)
+	{
+		for(int x = 0; x < boxX; x++)
+		{
+			const int ay = boxTop + y, ax = boxLeft + x;
+			water(y,x) = inArea(ay,ax) ? cells.height(ay,ax) : before.filled(ay,ax);
+		}
+	}
+	PriorityFlood(water).fill();
+	Progress::advance((long long)boxY * boxX);
+
+	/*	That water is only right if the ring's still is. A cell whose old way
+		off the DEM didn't go through the area still has it, but one whose way
+		did may have lost it. So the area and its collar are flooded again over
+		the new ground, from only the cells around the collar (and on the edge
+		of the DEM) that still have their way. Wherever that water is no higher
+		than the old, there is surely a way off the DEM at the old level.
+	*/
+	Grid<float> sure(outY, outX);
+	for(int y = 0; y < outY; y++)
+	{
+		for(int x = 0; x < outX; x++)
+		{
+			const int ay = outTop + y, ax = outLeft + x;
+			sure(y,x) = cells.height(ay,ax);
+			if((y == 0 || x == 0 || y == outY-1 || x == outX-1) && !inArea(ay,ax))
+				sure(y,x) = drainsIntoArea(ay,ax) ? numeric_limits<float>::max() : before.filled(ay,ax);
+		}
+	}
+	PriorityFlood(sure).fill();
+	Progress::advance((long long)outY * outX);
+
+	/*	The ring holds if each of its cells still has a sure way off the DEM at
+		its old level, and none can now drain lower through the area.
+	*/
+	vector<long> failed;
+	for(int y = 0; y < boxY; y++)
+	{
+		int step = (y == 0 || y == boxY-1) ? 1 : boxX-1;
+		for(int x = 0; x < boxX; x += step)
+		{
+			const int ay = boxTop + y, ax = boxLeft + x;
+			if(inArea(ay,ax) || onEdge(ay,ax)) continue;
+			const float ground = cells.height(ay,ax), level = before.filled(ay,ax);
+			bool lower = false;
+			for(int dir=north; dir<none; dir++)
+			{
+				const int ny = ay + dY[dir], nx = ax + dX[dir];
+				if(inArea(ny,nx) && max(ground, water(ny-boxTop, nx-boxLeft)) < level) lower = true;
+			}
+			if(lower || sure(ay-outTop, ax-outLeft) > level) failed.push_back(cells.index(ay,ax));
+		}
+	}
+	if(!failed.empty())
+	{
+		grow(failed);
+		return false;
+	}
+
+	//the rest of the DEM keeps the water it had
+	for(int y = 0; y < cellsY; y++)
+	{
+		const float *old = before.filled.row(y);
+		float *now = cells.height.row(y);
+		if(y < top || y >= bottom)
+		{
+			copy(old, old + cellsX, now);
+			continue;
+		}
+		const float *flooded = water.row(y - boxTop) + (left - boxLeft);
+		copy(old, old + left, now);
+		copy(flooded, flooded + (right - left), now + left);
+		copy(old + right, old + cellsX, now + right);
+	}
+	return true;
+}
+
+bool WindowUpdate::drainsIntoArea(int y, int x)
+{
+	const size_t first = looked.size();
+	unsigned char answer = ELSEWHERE;
+	while(true)
+	{
+		if(inArea(y,x))
+		{
+			answer = INTO_AREA;
+			break;
+		}
+		const long cell = marks.index(y,x);
+		if(marks[cell] != UNKNOWN)
+		{
+			//round in a circle, or the way on is known
+			answer = (marks[cell] == FOLLOWING) ? INTO_AREA : marks[cell];
+			break;
+		}
+		marks[cell] = FOLLOWING;
+		looked.push_back(cell);
+		const int dir = before.flowDirections[cell];
+		if(dir >= none)
+		{
+			//it had no way off at all, so it can't be counted on
+			answer = INTO_AREA;
+			break;
+		}
+		y += dY[dir];
+		x += dX[dir];
+		if(!marks.contains(y,x)) break;
+	}
+	for(size_t i = first; i < looked.size(); i++) marks[looked[i]] = answer;
+	return answer == INTO_AREA;
+}
+
+void WindowUpdate::grow(const vector<long>& failed)
+{
+	int newTop = top, newLeft = left, newBottom = bottom, newRight = right;
+	for(size_t i = 0; i < failed.size(); i++)
+	{
+		const int y = failed[i] / cellsX, x = failed[i] % cellsX;
+		newTop = min(newTop, y);
+		newLeft = min(newLeft, x);
+		newBottom = max(newBottom, y+1);
+		newRight = max(newRight, x+1);
+	}
+	//half as big again on the sides that failed, so it takes only a few floods
+	const int marginY = max(GROW_MARGIN, (bottom - top)/2), marginX = max(GROW_MARGIN, (right - left)/2);
+	if(newTop < top) top = max(newTop - marginY, 0);
+	if(newLeft < left) left = max(newLeft - marginX, 0);
+	if(newBottom > bottom) bottom = min(newBottom + marginY, cellsY);
+	if(newRight > right) right = min(newRight + marginX, cellsX);
+
+	//where the ring drains depends on where the area is
+	for(size_t i = 0; i < looked.size(); i++) marks[looked[i]] = UNKNOWN;
+	looked.clear();
+}
+
+void WindowUpdate::redirect()
+{
+	//everything else keeps its direction and total, unless it's downstream
+	copy(before.flowDirections.data(), before.flowDirections.data() + before.flowDirections.size(),
+		cells.flowDir.data());
+	copy(before.flowTotals.data(), before.flowTotals.data() + before.flowTotals.size(),
+		cells.flowTotal.data());
+	fill_n(marks.data(), marks.size(), 0);
+	for(int y = 0; y < cellsY; y++) cells.findNoData(y);
+
+	//the cells with a neighbor whose height changed: the area and a cell around it
+	const int zoneTop = max(top-1, 1), zoneLeft = max(left-1, 1);
+	const int zoneBottom = min(bottom+1, cellsY-1), zoneRight = min(right+1, cellsX-1);
+	vector<long> redo;
+	for(int y = zoneTop; y < zoneBottom; y++)
+	{
+		for(int x = zoneLeft; x < zoneRight; x++)
+		{
+			marks(y,x) = REDO;
+			redo.push_back(cells.index(y,x));
+		}
+	}
+
+	//and all of any flat they are on or next to, which drains as a whole
+	FlatResolver whole(cells.height, cells.flowDirSet, cells.noData);
+	int boxTop = zoneTop, boxLeft = zoneLeft, boxBottom = zoneBottom, boxRight = zoneRight;
+	vector<long> flat;
+	for(int y = zoneTop-1; y <= zoneBottom; y++)
+	{
+		for(int x = zoneLeft-1; x <= zoneRight; x++)
+		{
+			if((marks(y,x) & SEEN) || !whole.isFlat(y,x)) continue;
+			marks(y,x) |= SEEN;
+			flat.push_back(cells.index(y,x));
+			while(!flat.empty())
+			{
+				const long cell = flat.back();
+				flat.pop_back();
+				const int fy = cell / cellsX, fx = cell % cellsX;
+				if(!(marks[cell] & REDO)) redo.push_back(cell);
+				marks[cell] |= REDO;
+				boxTop = min(boxTop, fy);
+				boxLeft = min(boxLeft, fx);
+				boxBottom = max(boxBottom, fy+1);
+				boxRight = max(boxRight, fx+1);
+				for(int dir=north; dir<none; dir++)
+				{
+					const int ny = fy + dY[dir], nx = fx + dX[dir];
+					if((marks(ny,nx) & SEEN) || cells.height(ny,nx) != cells.height(fy,fx)
+						|| !whole.isFlat(ny,nx))
+						continue;
+					marks(ny,nx) |= SEEN;
+					flat.push_back(cells.index(ny,nx));
+				}
+			}
+		}
+	}
+
+	/*	Those flats are drained again on a part of the DEM big enough that its
+		edge doesn't cut them, starting on a word of the noData bits.
+	*/
+	boxTop = max(boxTop-2, 0);
+	boxLeft = max(boxLeft-2, 0) / 64 * 64;
+	boxBottom = min(boxBottom+2, cellsY);
+	boxRight = min(boxRight+2, cellsX);
+	const int boxY = boxBottom - boxTop, boxX = boxRight - boxLeft;
+	Progress::phase("directions", (long long)boxY * boxX);
+	for(int y = max(boxTop, 1); y < min(boxBottom, cellsY-1); y++)
+		cells.findFlowDirs(y, kernel, max(boxLeft, 1), min(boxRight, cellsX-1));
+	FlatResolver flats(cells.height.window(boxTop, boxLeft, boxY, boxX),
+						cells.flowDirSet.window(boxTop, boxLeft, boxY, boxX),
+						cells.noData.window(boxTop, boxLeft/64, boxY, (boxX+63)/64));
+	long flatCells = flats.resolve();
+	LOG(debug, "Directions found again for " << redo.size() << " cells, "
+		<< flatCells << " of them on flats\n");
+
+	vector<long> ties;
+	for(size_t i = 0; i < redo.size(); i++)
+	{
+		const long cell = redo[i];
+		const unsigned char dirs = cells.flowDirSet[cell];
+		cells.flowDir[cell] = none;
+		if(dirs & (dirs-1))
+			ties.push_back(cell);
+		else if(dirs)
+			for(int dir=north; dir<none; dir++)
+				if(dirs == dirBit(dir)) cells.flowDir[cell] = dir;
+	}
+	//as the trace would, each tie goes where the water already gets off the DEM
+	while(!ties.empty())
+	{
+		size_t kept = 0;
+		for(size_t i = 0; i < ties.size(); i++)
+			if(!chooseDirection(ties[i])) ties[kept++] = ties[i];
+		if(kept == ties.size()) break;	//no way off; the trace would leave them too
+		ties.resize(kept);
+	}
+	Progress::advance((long long)boxY * boxX);
+
+	vector<long> changed;
+	for(size_t i = 0; i < redo.size(); i++)
+		if(cells.flowDir[redo[i]] != before.flowDirections[redo[i]])
+			changed.push_back(redo[i]);
+	LOG(normal, "Calculating...\n");
+	Progress::phase("accumulate", changed.size());
+	cells.reaccumulate(changed, before.flowDirections);
+	Progress::advance(changed.size());
+}
+
+bool WindowUpdate::chooseDirection(long cell)
+{
+	const unsigned char dirs = cells.flowDirSet[cell];
+	const long longest = (long)cellsY * cellsX;
+	for(int dir=north; dir<none; dir++)
+	{
+		if(!(dirs & dirBit(dir))) continue;
+		//follow the water down from there, until it leaves the DEM or can't go on
+		int y = cell / cellsX + dY[dir], x = cell % cellsX + dX[dir];
+		bool off = false;
+		for(long steps = 0; steps < longest; steps++)
+		{
+			if(!cells.height.contains(y,x))
+			{
+				off = true;
+				break;
+			}
+			const long at = cells.index(y,x);
+			const int next = cells.flowDir[at];
+			if(at == cell || next == none) break;
+			y += dY[next];
+			x += dX[next];
+		}
+		if(!off) continue;
+		cells.flowDir[cell] = dir;
+		cells.flowDirSet[cell] = dirBit(dir);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,98 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <vector>
+
+#include "cell.h"
+#include "flats.h"
+#include "flood.h"
+#include "grid.h"
+
+using namespace std;
+
+//The results of an earlier run, laid out like the DEM; see Terrain::update().
+struct TerrainResults
+{
+	GridView<const float> filled;
+	GridView<const unsigned char> flowDirections;
+	GridView<const unsigned long long> flowTotals;
+};
+
+/*	Brings the results of an earlier run up to date after the heights changed
+	in one window of the DEM, doing over only what the change can reach:
+	- The water can only rise or fall where it reaches the window, so the
+	  window is flooded again from a ring of cells around it, which keep the
+	  water of the earlier run. If a cell of the ring drained through the
+	  window and can't any more, or can now drain lower through it, the area
+	  grows to take it in and is flooded again.
+	- The flow directions are found again in the area and one cell around it,
+	  and across any flat that reaches them.
+	- The flow totals change only downstream of a cell whose direction did.
+	The results are those of a run on the whole DEM, except that where the
+	flow can go more than one way into cells without data, it may go another
+	of them, as it can from one run to the next.
+*/
+class WindowUpdate
+{
+	public:
+	//The cells hold the new heights, unfilled; the kernel comes from flowDirsKernel().
+	WindowUpdate(CellGrid& cells, const TerrainResults& before, FlowDirsKernel kernel);
+	//the rows and columns of the DEM that changed; they must be inside it
+	void run(int y, int x, int rows, int columns);
+
+	private:
+	int cellsY, cellsX;
+	CellGrid& cells;
+	TerrainResults before;
+	FlowDirsKernel kernel;
+	//the area flooded again, from top to before bottom and left to before right
+	int top, left, bottom, right;
+	/*	While flooding, where each cell outside the area drained to by the old
+		directions, once it has been looked up; then which cells get their
+		directions found again.
+	*/
+	Grid<unsigned char> marks;
+	vector<long> looked;	//the cells marked while flooding
+
+	bool inArea(int y, int x) const
+	{
+		return y >= top && y < bottom && x >= left && x < right;
+	}
+	bool onEdge(int y, int x) const
+	{
+		return y == 0 || x == 0 || y == cellsY-1 || x == cellsX-1;
+	}
+	/*	Flood the area from the ring around it. Returns true and puts the
+		water in place if the ring holds, or grows the area and returns false.
+	*/
+	bool refill();
+	//whether the water of a cell outside the area used to drain through it
+	bool drainsIntoArea(int y, int x);
+	//make the area bigger, to take in the cells of the ring that failed
+	void grow(const vector<long>& failed);
+	//find the flow directions again wherever they can have changed
+	void redirect();
+	//give a cell with more than one way to go one that leads off the DEM
+	bool chooseDirection(long cell);
+};
+
+#endif
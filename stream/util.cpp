@@ -17,6 +17,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+
 #include "util.h"
 
 void sleep(int sec)
@@ -29,14 +31,208 @@ void sleep(int sec)
 	}catch(...){}
 }
 
-Logger::Logger() :level(normal), setlevel(maximum)
+LogRing::LogRing() : inUse(true), head(0), tail(0)
 {}
 
-Logger::~Logger() {}
+void LogRing::push(boost::uint64_t ticket, const char *text, size_t length)
+{
+	boost::uint32_t size = length;
+	size_t need = sizeof(ticket) + sizeof(size) + length;
+	size_t at = head.load(boost::memory_order_relaxed);
+	//wait for the logging thread to catch up
+	while(SIZE - (at - tail.load(boost::memory_order_acquire)) < need)
+		boost::this_thread::yield();
+	copyIn(at, reinterpret_cast<const char*>(&ticket), sizeof(ticket));
+	copyIn(at + sizeof(ticket), reinterpret_cast<const char*>(&size), sizeof(size));
+	copyIn(at + sizeof(ticket) + sizeof(size), text, length);
+	head.store(at + need, boost::memory_order_release);
+}
+
+bool LogRing::peek(boost::uint64_t& ticket)
+{
+	size_t at = tail.load(boost::memory_order_relaxed);
+	if(at == head.load(boost::memory_order_acquire)) return false;
+	copyOut(at, reinterpret_cast<char*>(&ticket), sizeof(ticket));
+	return true;
+}
+
+void LogRing::pop(ostream& out)
+{
+	size_t at = tail.load(boost::memory_order_relaxed);
+	boost::uint32_t size;
+	copyOut(at + sizeof(boost::uint64_t), reinterpret_cast<char*>(&size), sizeof(size));
+	at += sizeof(boost::uint64_t) + sizeof(size);
+	size_t end = at + size;
+	while(at < end)
+	{
+		size_t count = min(end - at, SIZE - at % SIZE);
+		out.write(buffer + at % SIZE, count);
+		at += count;
+	}
+	tail.store(end, boost::memory_order_release);
+}
+
+void LogRing::copyIn(size_t at, const char *from, size_t count)
+{
+	for(size_t piece; count > 0; at += piece, from += piece, count -= piece)
+	{
+		piece = min(count, SIZE - at % SIZE);
+		memcpy(buffer + at % SIZE, from, piece);
+	}
+}
+
+void LogRing::copyOut(size_t at, char *to, size_t count)
+{
+	for(size_t piece; count > 0; at += piece, to += piece, count -= piece)
+	{
+		piece = min(count, SIZE - at % SIZE);
+		memcpy(to, buffer + at % SIZE, piece);
+	}
+}
+
+//the log of the whole process, for the library and the programs alike
+Logger lg;
+
+Logger::Logger() :level(normal), setlevel(maximum), ring(releaseRing),
+	drainer(NULL), stopping(false), draining(false), pushing(0), tickets(0), nextTicket(0)
+{}
+
+Logger::~Logger()
+{
+	flush();
+	//the rings of threads that are still running stay, in case they log again
+	boost::mutex::scoped_lock lock(rings_mutex);
+	for(size_t i = 0; i < rings.size(); i++)
+	{
+		if(!rings[i]->inUse) delete rings[i];
+	}
+}
 
 void Logger::init(Loglevel lev)
 {
 	level = lev;
+	if(level > silent && !drainer)
+	{
+		stopping = false;
+		drainer = new boost::thread(&Logger::drain, this);
+		draining = true;
+	}
+}
+
+void Logger::flush()
+{
+	//new messages go straight out, once the ones being pushed are in the rings
+	draining = false;
+	while(pushing > 0) boost::this_thread::yield();
+	if(drainer)
+	{
+		stopping = true;
+		drainer->join();
+		delete drainer;
+		drainer = NULL;
+	}
+	boost::mutex::scoped_lock lock(rings_mutex);
+	catchUp();
+}
+
+void Logger::releaseRing(LogRing *ring)
+{
+	ring->inUse.store(false, boost::memory_order_release);
+}
+
+LogRing& Logger::threadRing()
+{
+	LogRing *mine = ring.get();
+	if(mine) return *mine;
+	
+	//take over the ring of a thread that has ended, or make a new one
+	boost::mutex::scoped_lock lock(rings_mutex);
+	for(size_t i = 0; i < rings.size() && !mine; i++)
+	{
+		bool free = false;
+		if(rings[i]->inUse.compare_exchange_strong(free, true)) mine = rings[i];
+	}
+	if(!mine)
+	{
+		mine = new LogRing;
+		rings.push_back(mine);
+	}
+	ring.reset(mine);
+	return *mine;
+}
+
+void Logger::push(const char *text, size_t length)
+{
+	//counted first, so that flush() waits for it if it saw the rings in use
+	pushing++;
+	if(draining)
+	{
+		LogRing& mine = threadRing();
+		do{
+			size_t piece = min(length, (size_t)LogRing::MAX_MESSAGE);
+			mine.push(tickets.fetch_add(1), text, piece);
+			text += piece;
+			length -= piece;
+		}while(length > 0);
+		pushing--;
+	}else{
+		pushing--;
+		//nothing to drain the rings, as before init() or after flush()
+		boost::mutex::scoped_lock lock(rings_mutex);
+		catchUp();
+		cout.write(text, length);
+		cout.flush();
+	}
+}
+
+void Logger::drain()
+{
+	while(!stopping)
+	{
+		drainAll();
+		boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+	}
+}
+
+void Logger::drainAll()
+{
+	/*	Merge the rings' messages back into the order they were logged in. A
+		thread takes its ticket before it pushes the message, so the next
+		ticket may not be in any ring yet; then the messages after it wait
+		for the next time.
+	*/
+	boost::mutex::scoped_lock lock(rings_mutex);
+	drainReady();
+}
+
+void Logger::drainReady()
+{
+	bool found = true;
+	while(found)
+	{
+		found = false;
+		boost::uint64_t ticket;
+		for(size_t i = 0; i < rings.size() && !found; i++)
+		{
+			if(rings[i]->peek(ticket) && ticket == nextTicket)
+			{
+				rings[i]->pop(cout);
+				nextTicket++;
+				found = true;
+			}
+		}
+	}
+	cout.flush();
+}
+
+void Logger::catchUp()
+{
+	drainReady();
+	while(nextTicket != tickets)
+	{
+		boost::this_thread::yield();
+		drainReady();
+	}
 }
 
 Logger& Logger::set(const Loglevel& type)
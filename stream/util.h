@@ -20,51 +20,18 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
-//Use a 2D index over a 1D array.
-template<typename T>
-T& linear(T *array, int y, int x, int width = -1)
-{
-	static int cellsX = -1;
-	if(width != -1) cellsX = width;
-	return array[y*cellsX+x];
-}
-
-//Index into a linear collection of elements on the OUTER EDGE of a matrix
-//stored in a 1D array
-template<typename T>
-T& edge(T *array, int x, int width = -1, int height = -1)
-{
-	static int cellsX = -1, cellsY = -1;
-	if(width != -1) cellsX = width;
-	if(height != -1) cellsY = height;
-	if(x<cellsX) 	//if we're in the first row: direct map
-	{
-		return array[x];
-	}
-	/* for the last row, the edge index plus all of the non-edge cells exceeds
-		all but the last row of the DEM. The excess is mapped to the last row.
-	*/
-	if(x > cellsX+cellsY*2-5)
-	{
-		return array[x + (cellsX-2)*(cellsY-2)];
-	}
-	// for cells on the vertical edges of the DEM, we ignore the first row.
-	x -= cellsX;
-	if(x%2 == 0)	//even offsets represent the left edge of the dem
-	{
-		return array[cellsX*(x/2+1)];
-	}
-	return array[cellsX*((x-1)/2+1) + (cellsX-1)];	//odd offset = right side
-}
-
 //Trivial predicate that just uses the < operator of the subject
 struct Pred
 {
@@ -78,30 +45,97 @@ void sleep(int sec);
 	on the log level that the program was run with
 */
 enum Loglevel {silent, normal, progress, debug, maximum};
+
+/*	Messages waiting to be logged from one thread. Only that thread puts
+	messages in, and only the logger's own thread takes them out, so neither
+	ever locks. Each message has a ticket saying where it goes among the
+	messages of every thread.
+*/
+class LogRing
+{
+	public:
+	enum {SIZE = 1 << 16, MAX_MESSAGE = SIZE / 4};
+	
+	LogRing();
+	//blocks while the ring is full. length can't be over MAX_MESSAGE
+	void push(boost::uint64_t ticket, const char *text, size_t length);
+	//the ticket of the oldest message, if there is one
+	bool peek(boost::uint64_t& ticket);
+	//write out the oldest message, and take it out
+	void pop(ostream& out);
+	
+	boost::atomic<bool> inUse;		//a thread is pushing to this ring
+	
+	private:
+	char buffer[SIZE];
+	boost::atomic<size_t> head, tail;	//total bytes pushed and taken out
+	
+	void copyIn(size_t at, const char *from, size_t count);
+	void copyOut(size_t at, char *to, size_t count);
+};
+
 class Logger
 {
 	private:
-	boost::mutex cout_mutex;
 	//the program's log level
 	Loglevel level;
 	//the level with which to write anything for which no Loglevel is given
 	Loglevel setlevel;
 	
+	//every thread that logs gets a ring, which goes back to the pool when it ends
+	boost::thread_specific_ptr<LogRing> ring;
+	vector<LogRing*> rings;
+	boost::mutex rings_mutex;
+	boost::thread *drainer;			//only init() and flush() touch it
+	boost::atomic<bool> stopping;
+	boost::atomic<bool> draining;		//messages go to the rings
+	boost::atomic<int> pushing;		//threads in push() that may be using the rings
+	boost::atomic<boost::uint64_t> tickets;
+	boost::uint64_t nextTicket;		//of the next message to write out
+	
+	static void releaseRing(LogRing *ring);
+	LogRing& threadRing();
+	void push(const char *text, size_t length);
+	void drain();
+	void drainAll();
+	//write out what is ready; rings_mutex must be held
+	void drainReady();
+	//write out every message that has a ticket, waiting for those still being pushed
+	void catchUp();
+	
 	public:
 	Logger();
 	~Logger();
 	
 	void init(Loglevel lev);
+	//write out everything logged so far, and stop the logging thread
+	void flush();
 	
+	bool enabled(Loglevel type) const {return type <= level;}
+	//the level of what << writes from now on. Every thread shares it, so code
+	//that can run beside other logging threads uses LOG instead
 	Logger& set(const Loglevel& type);
 	static Loglevel string2level(const string& str);
 	
+	void write(const Loglevel& type, char c)
+	{
+		if(enabled(type)) push(&c, 1);
+	}
+	void write(const Loglevel& type, const char *text)
+	{
+		if(enabled(type)) push(text, strlen(text));
+	}
+	void write(const Loglevel& type, const string& text)
+	{
+		if(enabled(type)) push(text.data(), text.size());
+	}
 	template<typename T>
 	void write(const Loglevel& type, const T& t)
 	{
-		if(type>level) return;
-		boost::mutex::scoped_lock lock(cout_mutex);
-		cout << t;
+		if(!enabled(type)) return;
+		ostringstream text;
+		text << t;
+		write(type, text.str());
 	}
 	
 	template<typename T>
@@ -112,4 +146,38 @@ class Logger
 	}
 };
 
+extern Logger lg;
+
+//Collects one message for LOG, and logs it all at once.
+class LogLine
+{
+	public:
+	LogLine(Loglevel type) : type(type) {}
+	~LogLine() {lg.write(type, text.str());}
+	
+	template<typename T>
+	LogLine& operator<<(const T& t)
+	{
+		text << t;
+		return *this;
+	}
+	
+	private:
+	Loglevel type;
+	ostringstream text;
+};
+
+/*	Logs a message made with <<, as in LOG(debug, "cell " << x << '\n').
+	Nothing in the message is even worked out unless the level is on. Build with
+	-DLOG_MAX_LEVEL=progress (say) to compile the more detailed ones away.
+*/
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL maximum
+#endif
+#define LOG(type, message) \
+	do{ \
+		if((type) <= LOG_MAX_LEVEL && lg.enabled(type)) \
+			LogLine(type) << message; \
+	}while(0)
+
 #endif
@@ -0,0 +1,98 @@
+/* LaharPlot is an application that can calculate and map out the inundation
+   zone of a lahar (volcanic mudslide) given an elevation map and some starting
+   parameters about the lahar itself.
+   Copyright 2009: Anthony Heathcoat, Jason Anderson, Tim Root
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <deque>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/*	A set of task queues, one per worker thread. Each worker takes tasks from
+	the back of its own queue and, once that runs dry, steals from the front of
+	the others' so no thread sits idle while there is work left.
+*/
+template<typename T>
+class WorkQueues
+{
+	public:
+	WorkQueues(int workers) : queues(workers)
+	{
+		for(int i=0; i<workers; i++) queues[i] = new Queue;
+	}
+	
+	~WorkQueues()
+	{
+		for(unsigned int i=0; i<queues.size(); i++) delete queues[i];
+	}
+	
+	int workers() const {return queues.size();}
+	
+	bool empty(int worker)
+	{
+		boost::mutex::scoped_lock lock(queues[worker]->lock);
+		return queues[worker]->tasks.empty();
+	}
+	
+	void push(int worker, const T& task)
+	{
+		boost::mutex::scoped_lock lock(queues[worker]->lock);
+		queues[worker]->tasks.push_back(task);
+	}
+	
+	//Get a task for the worker. Returns false when every queue is empty.
+	bool pop(int worker, T& task)
+	{
+		{
+			Queue& own = *queues[worker];
+			boost::mutex::scoped_lock lock(own.lock);
+			if(!own.tasks.empty())
+			{
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for(unsigned int i=1; i<queues.size(); i++)
+		{
+			Queue& victim = *queues[(worker+i) % queues.size()];
+			boost::mutex::scoped_lock lock(victim.lock);
+			if(!victim.tasks.empty())
+			{
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	private:
+	struct Queue
+	{
+		boost::mutex lock;
+		deque<T> tasks;
+	};
+	vector<Queue*> queues;
+};
+
+#endif
@@ -65,8 +65,8 @@ int main(int ac, char *av[]) {
 
 	char * helpText = (char*) "Display this help\n";
 
-	char * nameText = (char*) "Use the given simple name to open <arg>.ini, <arg>-sdem.tsv, "
-			          "and <arg>-fdir.tsv files.  All files must "
+	char * nameText = (char*) "Use the given simple name to open <arg>.ini, and <arg>.grids "
+			          "or else the <arg>-sdem.tsv and <arg>-fdir.tsv files.  All files must "
 			          "have same common name and be in the same directory.  The "
 			          "program will output the Inundated Zone file using the same name.  "
 			          "Can't be used with any other *-name options\n";
@@ -85,6 +85,10 @@ int main(int ac, char *av[]) {
 	char * fdirText = (char*) "Read flow directions for each cell from file with given name.  "
 					  "Can't be used with simple_name.  (File type = <arg>-fdir.tsv)\n";
 
+	char * gridText = (char*) "Read the SDEM and flow directions from the grid file stream writes, "
+					  "instead of from TSV files.  simple_name uses <arg>.grids when it "
+					  "exists.  (File type = <arg>.grids)\n";
+
 	char * outText  = (char*) "Output Inundated Zone to file using given name.  Can't be "
 					  "used with simple_name. (Result file = <arg>-zone#.tsv)\n";
 
@@ -128,13 +132,19 @@ int main(int ac, char *av[]) {
 					  "inundation zone.  The default print out time is three seconds.  To "
 					  "disable the status, set this option to zero.\n";
 
+	char * timeText = (char*) "Write the wall and CPU time, cells per second, peak memory and threads "
+					  "of each phase (reading the input, and calculating and writing each "
+					  "volume) to file <arg>, as JSON.\n";
+
 	// define variables to store command line information
 	string simpleName;
 	string directory;
 	string metaName;
 	string sdemName;
 	string fdirName;
+	string gridName;
 	string outName;
+	string timingsName;
 	double coeffA = .05;
 	double coeffB = 200;
 	int statTime = 3;
@@ -152,6 +162,7 @@ int main(int ac, char *av[]) {
 	bool metaNameSet = false;
 	bool sdemNameSet = false;
 	bool fdirNameSet = false;
+	bool gridNameSet = false;
 	bool outNameSet = false;
 	bool startXSet = false;
 	bool startYSet = false;
@@ -164,10 +175,15 @@ int main(int ac, char *av[]) {
 	string metaExt = ".ini";
 	string sdemExt = "-sdem.tsv";
 	string fdirExt = "-fdir.tsv";
+	string gridExt = ".grids";
+
+	// Phases timed for --timings, if it is set
+	Timings * timings = NULL;
 
-	// File parsed grids
-	double ** flowDirGrid;
-	double ** elevGrid;
+	// Grids, mapped from the grid file or parsed from TSV files
+	GridFile * gridFile = NULL;
+	const unsigned char * flowDirGrid;
+	const float * elevGrid;
 
 	// +-+-+-+-+-+-+-+ Parse Program Options +-+-+-+-+-+-+-+
 	try {
@@ -182,6 +198,7 @@ int main(int ac, char *av[]) {
 			("meta_data_file_name,m", po::value<string>(), metaText)
 			("SDEM_file_name,s", po::value<string>(), sdemText)
 			("flow_direction_grid_name,d", po::value<string>(), fdirText)
+			("grid_file_name,g", po::value<string>(), gridText)
 			("output_file_name,o", po::value<string>(), outText)
 			("coefficient_A,a", po::value<double>(), coAText)
 			("coefficient_B,b", po::value<double>(), coBText)
@@ -190,6 +207,7 @@ int main(int ac, char *av[]) {
 			("end_x,f", po::value<int>(), endxText)
 			("end_y,z", po::value<int>(), endyText)
 			("volume,v", po::value< vector<double> >(&tempVolumes)->multitoken(), volText)
+			("timings", po::value<string>(), timeText)
 		;
 
 		po::variables_map vm;
@@ -206,6 +224,7 @@ int main(int ac, char *av[]) {
 			metaName = vm["simple_name"].as<string>() + metaExt;
 			sdemName = vm["simple_name"].as<string>() + sdemExt;
 			fdirName = vm["simple_name"].as<string>() + fdirExt;
+			gridName = vm["simple_name"].as<string>() + gridExt;
 			outName = vm["simple_name"].as<string>();
 			simpleNameOn = true;
 
@@ -213,6 +232,7 @@ int main(int ac, char *av[]) {
 				 << "  Meta File Name:            " << metaName << "\n"
 				 << "  SDEM File Name:            " << sdemName << "\n"
 				 << "  Flow Direction File Name:  " << fdirName << "\n"
+				 << "  Grid File Name:            " << gridName << "\n"
 				 << "  Output file name(s):       " << outName  << "-zone#.tsv" << endl;
 		}
 
@@ -262,6 +282,19 @@ int main(int ac, char *av[]) {
 			}
 		}
 
+		if (vm.count("grid_file_name")) {
+
+			if (simpleNameOn)
+				cout << "Grid file name not set -> Simple name already designated" << endl;
+
+			else {
+				gridName = vm["grid_file_name"].as<string>() + gridExt;
+				gridNameSet = true;
+
+				cout << "Grid file name set to: " << gridName << endl;
+			}
+		}
+
 		if (vm.count("output_file_name")) {
 
 			if (simpleNameOn)
@@ -346,6 +379,14 @@ int main(int ac, char *av[]) {
 				cout << "Status timer set to " << statTime << "." << endl;
 
 		}
+
+		if (vm.count("timings")) {
+
+			timingsName = vm["timings"].as<string>();
+			timings = new Timings("zone");
+
+			cout << "Timings will be written to: " << timingsName << endl;
+		}
 	}
 	catch(const std::exception& e)
 	{
@@ -361,6 +402,7 @@ int main(int ac, char *av[]) {
 		metaName = directory + "/" + metaName;
 		sdemName = directory + "/" + sdemName;
 		fdirName = directory + "/" + fdirName;
+		gridName = directory + "/" + gridName;
 		outName  = directory + "/" + outName;
 	}
 
@@ -378,11 +420,11 @@ int main(int ac, char *av[]) {
     		cout << "Error:  " << "Simple name not used and Meta data file name not set" << endl;
     		inputMissing = true;
     	}
-    	if (!sdemNameSet) {
+    	if (!sdemNameSet && !gridNameSet) {
     		cout << "Error:  " << "Simple name not used and SDEM file name not set" << endl;
     		inputMissing = true;
     	}
-    	if (!fdirNameSet) {
+    	if (!fdirNameSet && !gridNameSet) {
     		cout << "Error:  " << "Simple name not used and Flow direction file name not set" << endl;
     		inputMissing = true;
     	}
@@ -420,11 +462,14 @@ int main(int ac, char *av[]) {
 
     // +-+-+-+-+-+-+-+ Parse INI file +-+-+-+-+-+-+-+
     // cellSize, xCells, yCells initialized here
+    int phase = (timings != NULL) ? timings->begin("ini", 0, 1) : -1;
     if ( !parseINI(metaName) )
     	return 1;
     else
     	if (verboseOn)
     		cout << "INI file read successfully" << endl;
+    if (timings != NULL)
+    	timings->end(phase);
 
     // +-+-+-+-+-+-+-+ Input Validity Checks +-+-+-+-+-+-+-+
     if (startX < 0) {
@@ -489,20 +534,48 @@ int main(int ac, char *av[]) {
 
     // x is the row coord, y is the column coord
 
-    //set up grids with ini file data
-    elevGrid    = new double*[xCells];
-    flowDirGrid = new double*[xCells];
-    for (int i = 0; i < xCells; i++) {
-    	elevGrid[i]    = new double [yCells];
-    	flowDirGrid[i] = new double [yCells];
+    // The grid file is used as it is on disk when there is one
+    bool useGridFile = gridNameSet || (simpleNameOn && boost::filesystem::exists(gridName));
+    if (timings != NULL)
+    	phase = timings->begin(useGridFile ? "grids" : "tsv", (long long) xCells * yCells, 1);
+    if (useGridFile) {
+    	try {
+    		gridFile = new GridFile(gridName);
+    	}
+    	catch(const std::exception& e) {
+    		cout << "Attempted to load " << e.what() << "\nProgram Exiting" << endl;
+    		return 1;
+    	}
+    	elevGrid    = gridFile->layer<float>("sdem", gridFloat32);
+    	flowDirGrid = gridFile->layer<unsigned char>("fdir", gridUInt8);
+    	if (elevGrid == NULL || flowDirGrid == NULL) {
+    		cout << gridName << " is missing the SDEM or flow directions\nProgram Exiting" << endl;
+    		return 1;
+    	}
+    	if (gridFile->width() != xCells || gridFile->height() != yCells) {
+    		cout << gridName << " doesn't match the size given in " << metaName << "\nProgram Exiting" << endl;
+    		return 1;
+    	}
+    	if (verboseOn)
+    		cout << "Grid file " << gridName << " mapped successfully" << endl;
     }
+    else {
+    	//set up grids with ini file data
+    	float * elevCells            = new float [xCells * yCells];
+    	unsigned char * flowDirCells = new unsigned char [xCells * yCells];
 
-    // parse each file; exit program if the return value is 0
-    if ( !parseTSV(sdemName, elevGrid) )
-    	return 1;
+    	// parse each file; exit program if the return value is 0
+    	if ( !parseTSV(sdemName, elevCells) )
+    		return 1;
 
-    if ( !parseTSV(fdirName, flowDirGrid) )
-    	return 1;
+    	if ( !parseTSV(fdirName, flowDirCells) )
+    		return 1;
+
+    	elevGrid    = elevCells;
+    	flowDirGrid = flowDirCells;
+    }
+    if (timings != NULL)
+    	timings->end(phase);
 
     // +-+-+-+-+-+-+-+ Create IZM +-+-+-+-+-+-+-+
     IZMData data;
@@ -516,6 +589,7 @@ int main(int ac, char *av[]) {
     data.coeffB		 = coeffB;
     data.outName     = outName;
     data.v  		 = verboseOn;
+    data.timings     = timings;
 
     MapperStatus * status = new MapperStatus(numVolumes, volumes);
 
@@ -527,6 +601,11 @@ int main(int ac, char *av[]) {
 	threads.join_all( );
 
 	status->printEndConditions( );
+	delete gridFile;
+
+	if (timings != NULL && !timings->write(timingsName))
+		cout << "Error:  Couldn't write the timings to " << timingsName << endl;
+	delete timings;
 
 	cout << "Finished" << endl;
 	return 1;
@@ -616,7 +695,7 @@ int parseINI(string name) {
  *    parseTSV
  *
  * This function takes the name of an TSV file, reads in the data,
- * and then stores it in the given grid.
+ * and then stores it in the given grid, one row after another.
  *
  * Parameters:
  * 		name - The name of an INI file.
@@ -624,11 +703,14 @@ int parseINI(string name) {
  * Return:
  * 		Returns 1 if successful, 0 otherwise.
  */
-int parseTSV(string name, double ** grid) {
-
-	ifstream file;
-	file.open(name.c_str());
-    if(!file) {
+template<typename T>
+int parseTSV(string name, T * grid) {
+
+	// read the compressed file instead if that's what there is
+	name = findTsv(name);
+	TsvInput input(name);
+	istream file(&input);
+    if(!input.is_open()) {
         cout << "Attempted to load " << name << " but was unsuccessful\nProgram Exiting" << endl;
         return 0;
     }
@@ -652,7 +734,7 @@ int parseTSV(string name, double ** grid) {
 
 		stream << line;
 		while (getline(stream, segment, '\t')) {
-			grid[segCounter][lineCounter] = atof(segment.c_str());
+			grid[lineCounter * xCells + segCounter] = (T) atof(segment.c_str());
 			segCounter ++;
 		}
 
@@ -677,17 +759,20 @@ int parseTSV(string name, double ** grid) {
 		lineCounter ++;
 	}
 
+	if (input.corrupt() || lineCounter != yCells) {
+		cout << endl << name << " is corrupt or cut short\nProgram Exiting" << endl;
+		return 0;
+	}
 	cout << endl << name + " has been successfully read" << endl;
 
 	/* Print
 	for (int i = 0; i < yCells; i++) {
 		cout << endl;
 		for (int j = 0; j < xCells; j++) {
-			cout << grid[j][i] << " ";
+			cout << grid[i * xCells + j] << " ";
 		}
 	}*/
 
-	file.close();
 	return 1;
 }
 
@@ -780,6 +865,7 @@ void outputInunGrid(double ** inunGrid, double volume, string outName, bool v) {
  * 		coefB - The coefficient to determine the maximum planimetric area
  * 		outName - The name of the output file to write the inundation grid to
  * 		v - Verbose boolean
+ * 		timings - Times the calculation and the output, if not NULL
  *   Outside IZMData Struct:
  *      volume - The volume of the expected lahar
  *      ID - The thread ID calling this function
@@ -792,8 +878,8 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 
 
 	// Locally store struct variables
-	double ** flowDirGrid = data.flowDirGrid;
-	double ** elevGrid    = data.elevGrid;
+	const unsigned char * flowDirGrid = data.flowDirGrid;
+	const float * elevGrid            = data.elevGrid;
 	int startX 			  = data.startX;
 	int startY			  = data.startY;
 	int endX			  = data.endX;
@@ -802,6 +888,7 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 	double coeffB		  = data.coeffB;
 	string outName 		  = data.outName;
 	bool v				  = data.v;
+	Timings * timings	  = data.timings;
 
 	// Declare Process Variables
 	double ** inunGrid;
@@ -812,6 +899,14 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 	int newRX = startX;
 	int newRY = startY;
 
+	// Time the calculation and the output on this thread alone
+	stringstream volumeStr;
+	volumeStr << volume;
+	const long long cells = (long long) xCells * yCells;
+	int phase = -1;
+	if (timings != NULL)
+		phase = timings->begin("izm " + volumeStr.str(), cells, 1, Timings::thread);
+
 	// Set Variables
 	maxCrossArea = getVolEqResult(coeffA, volume);
 	maxPlanArea  = getVolEqResult(coeffB, volume);
@@ -835,7 +930,7 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 
 		int rX = newRX;
 		int rY = newRY;
-		int flowDir = (int) flowDirGrid[rX][rY];
+		int flowDir = (int) flowDirGrid[rY * xCells + rX];
 		bool mapOverflowed = false;
 
 		// Convert current position markers to strings to use for status updates
@@ -978,6 +1073,8 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 			break;
 		default:
 			cout << "The Flow Direction Grid has supplied an unknown direction type.\nProgram exiting." << endl;
+			if (timings != NULL)
+				timings->end(phase);
 			return 0;
 
 		}
@@ -1067,10 +1164,18 @@ int createIZM(IZMData data, double volume, int ID, MapperStatus * status) {
 	if (v)
 		cout << "Inundation grid calculation ending for volume " << volume <<  endl;
 
+	if (timings != NULL) {
+		timings->end(phase);
+		phase = timings->begin("output " + volumeStr.str(), cells, 1, Timings::thread);
+	}
+
 	status->setStatus(ID, 0, true, false);
 	outputInunGrid(inunGrid, volume, outName, v);
 	status->setStatus(ID, 0, false, true);
 
+	if (timings != NULL)
+		timings->end(phase);
+
 	return 1;
 }
 
@@ -1115,7 +1220,7 @@ double getVolEqResult(double coeff, double volume) {
  * 		section went off the map the negative number of new inundated cells from the
  * 		cross section is returned.
  */
-int calcCrossSection(double ** inunGrid, double ** elevGrid, int rX, int rY, double maxCrossArea, CrossDir cD, bool gapCS, bool v) {
+int calcCrossSection(double ** inunGrid, const float * elevGrid, int rX, int rY, double maxCrossArea, CrossDir cD, bool gapCS, bool v) {
 
 	// Define process variables
 	double curCrossArea = 0;
@@ -1197,7 +1302,7 @@ int calcCrossSection(double ** inunGrid, double ** elevGrid, int rX, int rY, dou
 		cout << "*ERROR* Received a CrossDirection that does not exist *ERROR*" << endl;
 	}
 
-	fillLevel = elevGrid[curRX][curRY];
+	fillLevel = elevGrid[curRY * xCells + curRX];
 
 	// Set the stream cell to negative one for now so we can track the traversal
 	// Note this could cause an index out of bounds on the gap calculation, so for
@@ -1222,7 +1327,7 @@ int calcCrossSection(double ** inunGrid, double ** elevGrid, int rX, int rY, dou
 		// Determine if either cell has reached the edge of the map or hit an edge cell, and if so, return
 		if ( curRX < 0 || curRX > (xCells - 1) || curRY < 0 || curRY > (yCells - 1) ||
 			 curLX < 0 || curLX > (xCells - 1) || curLY < 0 || curLY > (yCells - 1)	||
-			 fillLevel < -200 || elevGrid[curRX][curRY] < -200 || elevGrid[curLX][curLY] < -200 ) {
+			 fillLevel < -200 || elevGrid[curRY * xCells + curRX] < -200 || elevGrid[curLY * xCells + curLX] < -200 ) {
 
 			if (v)
 				cout << "Cross section for stream cell has extended off the map.  Inundation zone calculation is finished." << endl;
@@ -1233,8 +1338,8 @@ int calcCrossSection(double ** inunGrid, double ** elevGrid, int rX, int rY, dou
 			return -newInunCounter;
 		}
 		else {
-			rightLevel = elevGrid[curRX][curRY];
-			leftLevel = elevGrid[curLX][curLY];
+			rightLevel = elevGrid[curRY * xCells + curRX];
+			leftLevel = elevGrid[curLY * xCells + curLX];
 		}
 
 		if (v)
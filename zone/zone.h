@@ -32,6 +32,7 @@
 #define ZONE_H
 
 #include <boost/config.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/program_options/detail/config_file.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -49,6 +50,10 @@
 #include <math.h>
 #include <time.h>
 
+#include "../stream/gridfile.h"
+#include "../stream/timings.h"
+#include "../stream/tsvinput.h"
+
 using namespace std;
 namespace po = boost::program_options;
 
@@ -63,8 +68,8 @@ enum CrossDir { N_S, NE_SW, E_W, SE_NW };
 // Struct containing the data to be passed to create IZM
 // Makes function call more readable, and allows boost's bind function to work (max args were 10)
 struct IZMData {
-	double ** flowDirGrid;
-	double ** elevGrid;
+	const unsigned char * flowDirGrid;
+	const float * elevGrid;
 	int startX;
 	int startY;
 	int endX;
@@ -73,6 +78,7 @@ struct IZMData {
 	double coeffB;
 	string outName;
 	bool v;
+	Timings * timings;
 };
 
 /**
@@ -237,7 +243,7 @@ int parseINI(string name);
  *    parseTSV
  *
  * This function takes the name of an TSV file, reads in the data,
- * and then stores it in the given grid.
+ * and then stores it in the given grid, one row after another.
  *
  * Parameters:
  * 		name - The name of an INI file.
@@ -245,7 +251,8 @@ int parseINI(string name);
  * Return:
  * 		Returns 1 if successful, 0 otherwise.
  */
-int parseTSV(string name, double ** grid);
+template<typename T>
+int parseTSV(string name, T * grid);
 
 /**
  *    createIZM
@@ -309,7 +316,7 @@ double getVolEqResult(double coeff, double volume);
  * Return:
  * 		Returns 1 if successful, 0 otherwise.
  */
-int calcCrossSection(double ** inunGrid, double ** elevGrid, int rX, int rY, double maxCrossArea, CrossDir cD, bool gapCS, bool v);
+int calcCrossSection(double ** inunGrid, const float * elevGrid, int rX, int rY, double maxCrossArea, CrossDir cD, bool gapCS, bool v);
 
 /**
  *    outputInunGrid